@@ -17,6 +17,7 @@
 #define E_FULL_TABLE (-1)
 #define HPAGE_NUM 0
 #define ADDR_NOT_EXIST 0
+#define LEAF_SPLIT 1
 
 typedef uint64_t addr;
 
@@ -37,25 +38,41 @@ typedef struct child{
 	addr v;
 } child;
 
+/* Keys of leaf are kept together, and value of i-th key
+ * is in cell slots[i]. Cells after num_keys are free, so only
+ * keys and slots are moved by insert and delete.
+ * Leaf made before has records and format 0. It is converted
+ * when it is read.
+ */
 typedef struct nblock{
 	addr parent; //8
 	int is_leaf; // 4
 	int num_keys; // 4
-	uint8_t pad[104]; // 104
+	int64_t format; // 8, LEAF_SPLIT in leaf
+	uint8_t slots[NUM_LEAF_REC]; // 31
+	uint8_t pad[65]; // 65
 	union{
 		addr sib;
 		addr leftmost;
 	}u1;
 	union{
 		child children[NUM_INT_KEY];
+		struct{
+			int64_t keys[NUM_LEAF_REC];
+			char values[NUM_LEAF_REC][VALUE_SIZE];
+		}leaf;
 		record recs[NUM_LEAF_REC];
 	}u2;
 #define i_leftmost u1.leftmost
 #define l_sib u1.sib
 #define i_children u2.children
+#define l_keys u2.leaf.keys
+#define l_values u2.leaf.values
 #define l_recs u2.recs
 } nblock;
 
+#define L_VALUE(nb, i) ((nb)->l_values[(nb)->slots[i]])
+
 typedef struct fblock{
 	addr next; //8
 	uint8_t pad[4088];
@@ -143,9 +160,17 @@ int init_bufmgr(conn *c, int buf_num);
 void close_bufmgr(conn *c);
 
 //Helper functions
+int search_children(nblock *nb, const int64_t k);
+int search_recs(nblock *nb, const int64_t k);
 npage *find_leaf(table *t, const int64_t k);
 int find_rec(table *t, npage *np, const int64_t k);
 int find_low(table *t, const int64_t k, record *r);
+void init_leaf(nblock *nb);
+void insert_rec(nblock *nb, int i, const record *r);
+void remove_rec(nblock *nb, int i);
+void get_rec(nblock *nb, int i, record *r);
+void set_recs(nblock *nb, record *recs, int num);
+void convert_leaf(npage *np);
 void print_tree(table *t);
 int cut( int length );
 npage *get_root(table *t);
@@ -9,6 +9,7 @@
 
 #define LEAF_ORDER 32
 #define INT_ORDER 249
+#define SEARCH_BLOCK 16
 
 //#define VERBOSE_TREE
 //#define DEBUG_TREE
@@ -5,24 +5,19 @@ int remove_entry_from_node(table *t, npage *np, int64_t k, int idx){
 	int i;
 
 	// Remove the key and shift other keys accordingly.
-	i = 0;
-	while (k != (nb->is_leaf ? nb->l_recs[i].k : nb->i_children[i].k))
-		i++;
+	if (nb->is_leaf){
+		remove_rec(nb, search_recs(nb, k));
+		return E_OK;
+	}
+	i = search_children(nb, k) - 1;
 
-	if (!nb->is_leaf && idx == 0){
+	if (idx == 0){
 		nb->i_leftmost = nb->i_children[0].v;
 	}
 	for (++i; i < nb->num_keys; i++){
-		if (nb->is_leaf)
-			nb->l_recs[i-1] = nb->l_recs[i];
-		else{
-			nb->i_children[i-1] = nb->i_children[i];
-		}
+		nb->i_children[i-1] = nb->i_children[i];
 	}
-	if (nb->is_leaf)
-		memset(&nb->l_recs[i-1], 0, sizeof(record));
-	else
-		memset(&nb->i_children[i-1], 0, sizeof(child));
+	memset(&nb->i_children[i-1], 0, sizeof(child));
 
 	// One key fewer.
 	nb->num_keys--;
@@ -82,6 +77,7 @@ int coalesce_nodes(table *t, npage *np, npage *neighbor, int neighbor_index, int
 	int i, j, neighbor_insertion_index, n_end;
 	nblock *nb;
 	npage *tmp, *parent;
+	record r;
 
 	/* Swap neighbor with node if node is on the
 	 * extreme left and neighbor is to its right.
@@ -142,9 +138,9 @@ int coalesce_nodes(table *t, npage *np, npage *neighbor, int neighbor_index, int
 	 */
 
 	else {
-		for (i = neighbor_insertion_index, j = 0; j < nb->num_keys; i++, j++) {
-			B(neighbor)->l_recs[i] = nb->l_recs[j];
-			B(neighbor)->num_keys++;
+		for (j = 0; j < nb->num_keys; j++) {
+			get_rec(nb, j, &r);
+			insert_rec(B(neighbor), B(neighbor)->num_keys, &r);
 		}
 		B(neighbor)->l_sib = nb->l_sib;
 	}
@@ -194,6 +190,7 @@ int redistribute_nodes(table *t, npage *np, npage *neighbor, int neighbor_index,
 	nblock *nb = B(np);
 	npage *parent;
 	npage *tmp;
+	record r;
 
 	/* Case: n has a neighbor to the left. 
 	 * Pull the neighbor's last key-pointer pair over
@@ -203,13 +200,9 @@ int redistribute_nodes(table *t, npage *np, npage *neighbor, int neighbor_index,
 	set_dirty(parent);
 
 	if (neighbor_index != -1) {
-		for (i = nb->num_keys; i > 0; i--) {
-			if (nb->is_leaf)
-				nb->l_recs[i] = nb->l_recs[i - 1];
-			else
-				nb->i_children[i] = nb->i_children[i - 1];
-		}
 		if (!nb->is_leaf) {
+			for (i = nb->num_keys; i > 0; i--)
+				nb->i_children[i] = nb->i_children[i - 1];
 			nb->i_children[0].v = nb->i_leftmost;
 			nb->i_leftmost = B(neighbor)->i_children[B(neighbor)->num_keys-1].v;
 			tmp = get_child(t, np, 0);
@@ -223,9 +216,10 @@ int redistribute_nodes(table *t, npage *np, npage *neighbor, int neighbor_index,
 			memset(&B(neighbor)->i_children[B(neighbor)->num_keys], 0, sizeof(child));
 		}
 		else {
-			nb->l_recs[0] = B(neighbor)->l_recs[B(neighbor)->num_keys - 1];
-			memset(&B(neighbor)->l_recs[B(neighbor)->num_keys - 1], 0, sizeof(record));
-			B(parent)->i_children[k_prime_index].k = nb->l_recs[0].k;
+			get_rec(B(neighbor), B(neighbor)->num_keys - 1, &r);
+			insert_rec(nb, 0, &r);
+			remove_rec(B(neighbor), B(neighbor)->num_keys - 1);
+			B(parent)->i_children[k_prime_index].k = nb->l_keys[0];
 		}
 	}
 
@@ -237,8 +231,10 @@ int redistribute_nodes(table *t, npage *np, npage *neighbor, int neighbor_index,
 
 	else {  
 		if (nb->is_leaf) {
-			nb->l_recs[nb->num_keys] = B(neighbor)->l_recs[0];
-			B(parent)->i_children[k_prime_index].k = B(neighbor)->l_recs[1].k;
+			get_rec(B(neighbor), 0, &r);
+			insert_rec(nb, nb->num_keys, &r);
+			remove_rec(B(neighbor), 0);
+			B(parent)->i_children[k_prime_index].k = B(neighbor)->l_keys[0];
 		}
 		else {
 			nb->i_children[nb->num_keys].k = k_prime;
@@ -250,21 +246,20 @@ int redistribute_nodes(table *t, npage *np, npage *neighbor, int neighbor_index,
 			B(parent)->i_children[k_prime_index].k = B(neighbor)->i_children[0].k;
 
 			B(neighbor)->i_leftmost = B(neighbor)->i_children[0].v;
-		}
-		for (i = 0; i < B(neighbor)->num_keys - 1; i++) {
-			if (B(neighbor)->is_leaf)
-				B(neighbor)->l_recs[i] = B(neighbor)->l_recs[i + 1];
-			else
+			for (i = 0; i < B(neighbor)->num_keys - 1; i++)
 				B(neighbor)->i_children[i] = B(neighbor)->i_children[i + 1];
 		}
 	}
 
 	/* n now has one more key and one more pointer;
 	 * the neighbor has one fewer of each.
+	 * Records of leaf are counted by insert_rec and remove_rec.
 	 */
 
-	nb->num_keys++;
-	B(neighbor)->num_keys--;
+	if (!nb->is_leaf) {
+		nb->num_keys++;
+		B(neighbor)->num_keys--;
+	}
 
 	release_page(t, parent);
 
@@ -355,20 +350,18 @@ int delete_entry(table *t, npage *np, int64_t k, int idx){
 /* Master internal deletion function.
  */
 int delete_low(table *t, int64_t k) {
-	DEC_RET;
 	npage *key_leaf;
-	record r;
 	int idx;
 
-	RET(find_low(t, k, &r));
-
-	key_leaf = find_leaf(t, k);
-	if (key_leaf != NULL) {
-		set_dirty(key_leaf);
-		idx = find_rec(t, key_leaf, k);
-		delete_entry(t, key_leaf, k, idx);
+	// Key is checked in the leaf, so the tree is descended once.
+	if ((key_leaf = find_leaf(t, k)) == NULL)
+		return E_NOT_FOUND;
+	if ((idx = find_rec(t, key_leaf, k)) == -1){
 		release_page(t, key_leaf);
-		return E_OK;
+		return E_NOT_FOUND;
 	}
+	set_dirty(key_leaf);
+	delete_entry(t, key_leaf, k, idx);
+	release_page(t, key_leaf);
 	return E_OK;
 }
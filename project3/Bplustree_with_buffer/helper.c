@@ -1,4 +1,89 @@
 #include "bptree.h"
+#include <immintrin.h>
+
+/* Keys in node are searched by branchless binary search
+ * until SEARCH_BLOCK keys are left, and keys of the block
+ * are compared at once by SSE4.2 or AVX2 if CPU has it.
+ * Keys are stride int64 apart in internal node, and
+ * contiguous in leaf.
+ */
+typedef int (*count_fn)(const int64_t *keys, int stride, int num, int64_t k, bool less);
+
+// Counts keys <= k, or keys < k if less is true.
+static int count_scalar(const int64_t *keys, int stride, int num, int64_t k, bool less){
+	int i, n = 0;
+	for (i = 0; i < num; i++)
+		n += less ? keys[i * stride] < k : keys[i * stride] <= k;
+	return n;
+}
+
+__attribute__((target("sse4.2")))
+static int count_sse42(const int64_t *keys, int stride, int num, int64_t k, bool less){
+	int i, n = 0;
+	__m128i kv = _mm_set1_epi64x(k);
+	__m128i v, gt;
+
+	for (i = 0; i + 2 <= num; i += 2){
+		v = stride == 1 ? _mm_loadu_si128((const __m128i *)(keys + i)) :
+			_mm_set_epi64x(keys[(i + 1) * stride], keys[i * stride]);
+		gt = less ? _mm_cmpgt_epi64(kv, v) : _mm_cmpgt_epi64(v, kv);
+		n += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(gt)));
+	}
+	if (!less) n = i - n;
+	return n + count_scalar(keys + i * stride, stride, num - i, k, less);
+}
+
+__attribute__((target("avx2")))
+static int count_avx2(const int64_t *keys, int stride, int num, int64_t k, bool less){
+	int i, n = 0;
+	__m256i kv = _mm256_set1_epi64x(k);
+	__m256i index = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+	__m256i v, gt;
+
+	for (i = 0; i + 4 <= num; i += 4){
+		v = stride == 1 ? _mm256_loadu_si256((const __m256i *)(keys + i)) :
+			_mm256_i64gather_epi64((const long long *)(keys + i * stride), index, 8);
+		gt = less ? _mm256_cmpgt_epi64(kv, v) : _mm256_cmpgt_epi64(v, kv);
+		n += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+	}
+	if (!less) n = i - n;
+	return n + count_scalar(keys + i * stride, stride, num - i, k, less);
+}
+
+static count_fn count_keys = NULL;
+
+// Answer is kept in [base, base + num] while range is halved.
+static int search_keys(const int64_t *keys, int stride, int num, int64_t k, bool less){
+	int base = 0, half;
+	int64_t key;
+
+	if (count_keys == NULL){
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) count_keys = count_avx2;
+		else if (__builtin_cpu_supports("sse4.2")) count_keys = count_sse42;
+		else count_keys = count_scalar;
+	}
+	while (num > SEARCH_BLOCK){
+		half = num / 2;
+		key = keys[(base + half - 1) * stride];
+		base += (less ? key < k : key <= k) * half;
+		num -= half;
+	}
+	return base + count_keys(keys + base * stride, stride, num, k, less);
+}
+
+/* Returns the number of keys <= k in internal node.
+ * It is the index of child to follow.
+ */
+int search_children(nblock *nb, const int64_t k){
+	return search_keys(&nb->i_children[0].k, sizeof(child) / sizeof(int64_t),
+			nb->num_keys, k, false);
+}
+
+// Returns the index of the first record whose key >= k in leaf.
+int search_recs(nblock *nb, const int64_t k){
+	return search_keys(nb->l_keys, 1, nb->num_keys, k, true);
+}
 
 /* Traces the path from the root to a leaf, searching
  * by key.  Displays information about the path
@@ -21,11 +106,7 @@ npage *find_leaf(table *t, const int64_t k) {
 	np = get_root(t);
 	nb = B(np);
 	while (!nb->is_leaf) {
-		i = 0;
-		while (i < nb->num_keys) {
-			if (k >= nb->i_children[i].k) i++;
-			else break;
-		}
+		i = search_children(nb, k);
 		next_np = get_child(t, np, i);
 		release_page(t, np);
 		np = next_np;
@@ -36,11 +117,77 @@ npage *find_leaf(table *t, const int64_t k) {
 
 int find_rec(table *t, npage *np, const int64_t k){
 	nblock *nb = B(np);
+	int i = search_recs(nb, k);
+	if (i < nb->num_keys && nb->l_keys[i] == k) return i;
+	return -1;
+}
+
+/* Make leaf empty. Every cell is free.
+ */
+void init_leaf(nblock *nb){
+	set_recs(nb, NULL, 0);
+}
+
+/* Insert record as i-th record of leaf.
+ * Value goes to the first free cell.
+ */
+void insert_rec(nblock *nb, int i, const record *r){
+	uint8_t cell = nb->slots[nb->num_keys];
+	int num = nb->num_keys - i;
+
+	memmove(&nb->l_keys[i+1], &nb->l_keys[i], sizeof(int64_t) * num);
+	memmove(&nb->slots[i+1], &nb->slots[i], num);
+	nb->l_keys[i] = r->k;
+	nb->slots[i] = cell;
+	memcpy(L_VALUE(nb, i), r->v, VALUE_SIZE);
+	nb->num_keys++;
+}
+
+/* Remove i-th record of leaf. Its cell becomes free.
+ */
+void remove_rec(nblock *nb, int i){
+	uint8_t cell = nb->slots[i];
+	int num = nb->num_keys - i - 1;
+
+	memmove(&nb->l_keys[i], &nb->l_keys[i+1], sizeof(int64_t) * num);
+	memmove(&nb->slots[i], &nb->slots[i+1], num);
+	nb->num_keys--;
+	nb->slots[nb->num_keys] = cell;
+}
+
+void get_rec(nblock *nb, int i, record *r){
+	r->k = nb->l_keys[i];
+	memcpy(r->v, L_VALUE(nb, i), VALUE_SIZE);
+}
+
+/* Replace records of leaf with sorted records,
+ * which are not in the leaf.
+ */
+void set_recs(nblock *nb, record *recs, int num){
 	int i;
-	for (i = 0; i < nb->num_keys; i++){
-		if (nb->l_recs[i].k == k) return i;
+
+	nb->format = LEAF_SPLIT;
+	for (i = 0; i < NUM_LEAF_REC; i++)
+		nb->slots[i] = i;
+	for (i = 0; i < num; i++){
+		nb->l_keys[i] = recs[i].k;
+		memcpy(nb->l_values[i], recs[i].v, VALUE_SIZE);
 	}
-	return -1;
+	nb->num_keys = num;
+}
+
+/* Convert leaf made before keys and values were split.
+ */
+void convert_leaf(npage *np){
+	nblock *nb = B(np);
+	record old[NUM_LEAF_REC];
+	int num = nb->num_keys;
+
+	if (num > NUM_LEAF_REC)
+		panic("convert_leaf");
+	memcpy(old, nb->l_recs, sizeof(record) * num);
+	set_recs(nb, old, num);
+	set_dirty(np);
 }
 
 /* Finds and returns the record to which
@@ -68,7 +215,7 @@ int find_low(table *t, const int64_t k, record *r){
 		release_page(t, np);
 		return E_NOT_FOUND;
 	}
-	memcpy(r, &nb->l_recs[idx], sizeof(record));
+	get_rec(nb, idx, r);
 	release_page(t, np);
 	return E_OK;
 }
@@ -106,7 +253,7 @@ void print_tree(table *t) {
 		np = queue[head++];
 		if (B(np)->is_leaf){
 			for (i = 0; i < B(np)->num_keys; i++)
-				printf("%ld ",B(np)->l_recs[i].k);
+				printf("%ld ",B(np)->l_keys[i]);
 		}
 		else{
 			queue[tail] = get_child(t, np, 0);
@@ -195,6 +342,8 @@ npage *get_parent(table *t, npage *np){
  */
 npage *get_npage(table *t, addr ad){
 	npage *np = (npage *)get_page(t, ad);
+	if (B(np)->is_leaf && B(np)->format != LEAF_SPLIT)
+		convert_leaf(np);
 	return np;
 }
 
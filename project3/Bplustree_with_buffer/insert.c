@@ -29,6 +29,7 @@ npage *make_leaf(table *t){
 
 	nb->is_leaf = true;
 	nb->l_sib = ADDR_NOT_EXIST;
+	init_leaf(nb);
 
 	return np;
 }
@@ -54,16 +55,9 @@ void set_root(table *t, npage *np){
  */
 int insert_into_leaf(table *t, npage *leaf, const record *r){
 	nblock *nb = B(leaf);
-	int i, j;
 
-	for (i = 0; i < nb->num_keys; i++){
-		if (r->k < nb->l_recs[i].k) break;
-	}
-	nb->num_keys++;
-	for (j = nb->num_keys-1; j > i; j--){
-		nb->l_recs[j] = nb->l_recs[j-1];
-	}
-	nb->l_recs[i] = *r;
+	// Only keys and slots are moved.
+	insert_rec(nb, search_recs(nb, r->k), r);
 	return E_OK;
 }
 
@@ -272,46 +266,29 @@ int insert_into_leaf_after_splitting(table *t, npage *np, record *r) {
 	nblock *nb = B(np);
 	npage *new_np;
 	nblock *new_nb;
-	record *temp_recs[NUM_LEAF_REC+1];
-	int insertion_index, split, i;
+	record temp_recs[NUM_LEAF_REC+1];
+	int insertion_index, split, i, j;
 	int64_t new_key;
 
 	new_np = make_leaf(t);
 	new_nb = B(new_np);
 	set_dirty(new_np);
 
-	insertion_index = 0;
+	insertion_index = search_recs(nb, r->k);
 	split = cut(LEAF_ORDER-1);
 
-	while (insertion_index < nb->num_keys && nb->l_recs[insertion_index].k < r->k){
-		temp_recs[insertion_index] = &nb->l_recs[insertion_index];
-		insertion_index++;
-	}
-	temp_recs[insertion_index] = r;
-
-	for (i = insertion_index+1; i < LEAF_ORDER; i++){
-		temp_recs[i] = &nb->l_recs[i-1];
+	for (i = 0, j = 0; i < nb->num_keys; i++, j++){
+		if (j == insertion_index) j++;
+		get_rec(nb, i, &temp_recs[j]);
 	}
+	temp_recs[insertion_index] = *r;
 
-	new_key = temp_recs[split]->k;
 	new_nb->l_sib = nb->l_sib;
 	nb->l_sib = new_np->offset;
 
-	for (i = split; i <= nb->num_keys; i++){
-		new_nb->l_recs[i - split] = *temp_recs[i];
-	}
-
-	new_nb->num_keys = i - split;
-
-	for (i = split-1; i >= 0; i--){
-		if (temp_recs[i] != &nb->l_recs[i])
-			nb->l_recs[i] = *temp_recs[i];
-	}
-
-	for (i = split; i < nb->num_keys; i++)
-		memset(&nb->l_recs[i], 0, sizeof(child));
-
-	nb->num_keys = split;
+	set_recs(new_nb, &temp_recs[split], LEAF_ORDER - split);
+	set_recs(nb, temp_recs, split);
+	new_key = new_nb->l_keys[0];
 	new_nb->parent = nb->parent;
 
 	ret = insert_into_parent(t, np, new_key, new_np);
@@ -327,35 +304,24 @@ int insert_into_leaf_after_splitting(table *t, npage *np, record *r) {
  */
 int insert_low( table *t, record *r) {
 	DEC_RET;
-	hpage *hp;
-	record dup;
 	npage *leaf;
 
-	/* The current implementation ignores
-	 * duplicates.
-	 */
-
-	if (find_low(t, r->k, &dup) == E_OK)
-		return E_DUP;
-
 	/* Case: the tree does not exist yet.
 	 * Start a new tree.
 	 */
 
-	hp = get_hpage(t);
-	if (B(hp)->root == ADDR_NOT_EXIST){
-		release_page(t, hp);
+	if ((leaf = find_leaf(t, r->k)) == NULL)
 		return start_new_tree(t, r);
-	}
-	release_page(t, hp);
-
 
 	/* Case: the tree already exists.
-	 * (Rest of function body.)
+	 * Duplicate is checked in the leaf,
+	 * so the tree is descended once.
 	 */
 
-	if ((leaf = find_leaf(t, r->k)) == NULL)
-		panic("insert"); 
+	if (find_rec(t, leaf, r->k) != -1){
+		release_page(t, leaf);
+		return E_DUP;
+	}
 
 	set_dirty(leaf);
 
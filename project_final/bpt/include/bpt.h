@@ -15,24 +15,50 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stddef.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 #define false 0
 #define true 1
 
-#define LEAF_ORDER 32
-#define INTERNAL_ORDER	249
 #define PAGE_HEADER 128
 #define HEADERPAGE_OFFSET 0
 #define VALUE_SIZE	120
-#define PAGE_SIZE	4096
+#define DEFAULT_PAGE_SIZE	4096
+#define MIN_PAGE_SIZE	4096
+#define MAX_PAGE_SIZE	32768
+#define MAX_LEAF_ORDER	((MAX_PAGE_SIZE - PAGE_HEADER) / 128 + 1)
+#define MAX_INTERNAL_ORDER	((MAX_PAGE_SIZE - PAGE_HEADER) / 16 + 1)
 #define PAGE_NONE	-1
 #define OUTPUT_BUFFER	0
 #define OUTPUT_OFFSET	-2
-#define JOIN_RESULT_SIZE	16
 #define LOG_BUFFER_SIZE	100
-#define LOG_SIZE	8232
 #define LOG_INIT_NUM	-1
 #define LOG_HEADER_SIZE	40
+#define HASH_EMPTY	-1
+#define CLEANER_DEPTH	128		// Number of pages page cleaner watches at cold end.
+#define CLEANER_BATCH	32		// Max number of pages page cleaner writes at once.
+#define CLEANER_INTERVAL	100	// Default sleep time of page cleaner (ms).
+#define PARTITION_MIN_FRAMES	16	// Min number of frames of buffer pool partition.
+#define PIN_WAIT_TIMEOUT	1	// Time to wait for unpinned page before warning (s).
+#define POOL_RESERVE_FACTOR	8	// Without max_frames option, pool can grow to 8 times of initial size.
+#define WARMUP_FILE	"minidb.warm"	// Resident pages saved for warm-up.
+#define WARMUP_BATCH	32		// Number of pages warm-up reads at once.
+#define HUGE_PAGE_SIZE	(2 * 1024 * 1024)	// Size of transparent huge page.
+#define READAHEAD_PAGES	16		// Default number of leaf pages read ahead of leaf chain scan.
+#define READAHEAD_MAX	64		// Max number of leaf pages read ahead at once.
+#define READAHEAD_QUEUE	64		// Number of read-ahead requests waiting for thread.
+#define IO_QUEUE_DEPTH	64		// Entries of io_uring submission queue of each thread.
+#define FLUSH_RUN_MAX	256		// Max number of pages written by one request of flush.
+#define VICTIM_DEPTH	64		// Number of cold pages make_victim looks at for table quotas.
+#define SEARCH_BLOCK	16		// Binary search in page stops at this number of keys.
+#define BULK_FILL_FACTOR	90	// Default percent of page filled by bulk load.
+#define BULK_BATCH	64		// Max number of pages bulk load writes at once.
+#define LEAF_SPLIT	1		// Format of leaf whose keys and values are split.
+#define LEAF_HEADER_SLOTS	80	// Slot array is in leaf header if it has at most this many slots.
 
 // TYPES.
 
@@ -55,28 +81,52 @@ typedef enum LOG_TYPE {
 	ROLLBACK
 } LOG_TYPE;
 
+// Replacement policy of buffer pool.
+typedef enum POLICY_TYPE {
+	POLICY_LRU,
+	POLICY_CLOCK,
+	POLICY_CLOCK_PRO
+} POLICY_TYPE;
+
+// How page and log writes are made durable.
+typedef enum DURABILITY_TYPE {
+	DURABILITY_STRICT,		// Every write is synchronous by O_SYNC.
+	DURABILITY_WAL,			// Log is synced when flushed, data files at checkpoint.
+	DURABILITY_UNSAFE		// Nothing is synced. For bulk load.
+} DURABILITY_TYPE;
+
+typedef enum TABLE_MODE {
+	TABLE_READ_WRITE,		// Pages are read into buffer pool.
+	TABLE_MMAP				// Read only. Pages are read from memory mapping of file.
+} TABLE_MODE;
+
+// Priority class of table in buffer pool. Pages of lower class are evicted first.
+typedef enum PRIORITY_TYPE {
+	PRIORITY_LOW,
+	PRIORITY_NORMAL,
+	PRIORITY_HIGH
+} PRIORITY_TYPE;
+
+typedef enum IO_TYPE {
+	IO_BLOCKING,
+	IO_URING
+} IO_TYPE;
+
+/* How page is accessed.
+ * Pages read by leaf chain scan are ACCESS_SCAN.
+ * They are kept at cold end of replacement policy,
+ * so scan doesn't flush hot pages.
+ */
+typedef enum ACCESS_TYPE {
+	ACCESS_RANDOM,
+	ACCESS_SCAN
+} ACCESS_TYPE;
+
+// Only first page_size bytes of page are used.
 typedef struct Page {
-	char context[PAGE_SIZE];
+	char context[MAX_PAGE_SIZE];
 } Page;
 
-typedef struct LRU LRU;
-
-typedef struct Buf {
-	Page * page;
-	int64_t table_id;	// table_id is (fd - 2).
-	int64_t page_offset;
-	bool is_dirty;		// When victim page is removed in LRU, if it is true, call write_page function.
-	int pin_count;		// If it is in using, increment pin_count.
-	bool in_LRU;		// If its page is in LRU, return true.
-	LRU * lru;			// Each Buf structure has its LRU structure.
-} Buf;
-
-struct LRU {
-	Buf * buf;
-	struct LRU * prev;
-	struct LRU * next;
-};
-
 // JOIN operation
 
 typedef struct resultvalue{
@@ -86,18 +136,11 @@ typedef struct resultvalue{
 		char value2[120];
 } result_value; 
 
+// Output page of join holds join_result_size values.
 typedef struct result {
-	result_value value[16];
+	result_value value[MAX_PAGE_SIZE / sizeof(result_value)];
 } result_page;
 
-// It LRU_list means buffer list.
-// When reading the page, LRU structure of Page is located head of LRU_list.
-typedef struct LRU_list {
-	LRU * head;
-	LRU * tail;
-	int num_lru;
-} LRU_LIST;
-
 typedef struct leaf_record {
 	int64_t key;
 	char value[120];
@@ -118,7 +161,7 @@ typedef struct log_header {
 	int table_id;
 	int page_num;
 	int offset;
-	int length;
+	int length;		// Page size of images.
 } log_header;
 
 
@@ -130,13 +173,218 @@ typedef struct log {
 } Log;
 
 #pragma pack(pop)
+
+// BUFFER POOL
+
+typedef struct LRU LRU;
+
+typedef struct Buf {
+	Page * page;
+	int64_t table_id;	// table_id is (fd - 2).
+	int64_t page_offset;
+	bool is_dirty;		// When victim page is removed in LRU, if it is true, call write_page function.
+	int pin_count;		// If it is in using, increment pin_count.
+	bool in_LRU;		// If its page is managed by replacement policy, return true.
+	LRU * lru;			// Each Buf structure has its LRU structure.
+	bool ref;			// Reference bit of CLOCK and CLOCK-Pro.
+	bool hot;			// CLOCK-Pro : page is hot.
+	bool test;			// CLOCK-Pro : cold page is in its test period.
+	int part;			// Index of partition which owns this frame.
+	bool io_pending;	// Page is being read by read-ahead thread.
+	bool retire;		// Frame is cut off by resize, and removed when unpinned.
+} Buf;
+
+struct LRU {
+	Buf * buf;
+	struct LRU * prev;
+	struct LRU * next;
+};
+
+// It LRU_list means buffer list.
+// When reading the page, LRU structure of Page is located head of LRU_list.
+typedef struct LRU_list {
+	LRU * head;
+	LRU * tail;
+	int num_lru;
+} LRU_LIST;
+
+// Page table maps (table_id, page_offset) to index of buffer frame.
+// It is open addressing hash table with linear probing.
+typedef struct hash_entry {
+	int64_t page_offset;
+	int table_id;
+	int frame;			// If slot is unused, frame is HASH_EMPTY.
+} hash_entry;
+
+typedef struct page_hash {
+	hash_entry * entries;
+	int size;			// Number of slots. It is power of 2.
+	int num_entries;
+} page_hash;
+
+/* Buffer pool is split into partitions.
+ * Page belongs to partition by hash of (table_id, page_offset).
+ * Each partition has its own latch, page table, free frames
+ * and replacement state, and owns frames whose index % num_partitions
+ * is its index.
+ */
+// Counters of buffer pool. Each partition counts under its latch.
+typedef struct buf_stats {
+	int64_t hits;
+	int64_t misses;
+	int64_t evictions;
+	int64_t writebacks;		// Dirty pages written by eviction, page cleaner and flush.
+	int64_t pin_waits;		// Times make_victim waited for unpinned page.
+	int64_t wal_flushes;	// Log flushes forced by eviction of page.
+	int64_t prefetches;		// Pages read by read-ahead and warm-up.
+} buf_stats;
+
+// Statistics returned by get_db_stats.
+typedef struct db_stats {
+	buf_stats buf;
+	int64_t bytes_read[11];		// Bytes read from each table.
+	int64_t bytes_written[11];	// Bytes written to each table.
+} db_stats;
+
+typedef struct buf_partition {
+	pthread_mutex_t latch;
+	pthread_cond_t cond;		// Signaled when pages are unpinned.
+	int num_waiters;			// Number of threads waiting for unpinned page.
+	bool cleaner_writing;		// Page cleaner holds pinned pages for write.
+	int * frames;				// Indexes of frames of this partition.
+	int num_frames;
+	page_hash page_table;
+	int * free_frames;			// Stack of indexes of frames which don't hold page.
+	int num_free;
+
+	// Replacement state. Hands are positions in frames.
+	LRU_LIST * lru_list;		// LRU
+	int hand;					// CLOCK, and cold hand of CLOCK-Pro.
+	int hot_hand;				// CLOCK-Pro
+	int num_hot;
+	int cold_target;			// Target number of resident cold pages.
+	page_hash ghost_table;		// (table_id, page_offset) of ghost page to index of ghost_ring.
+	hash_entry * ghost_ring;
+	int ghost_head;
+	int num_ghost;
+
+	buf_stats stats;
+	int table_frames[11];		// Number of resident pages of each table.
+} buf_partition;
+
+/* Replacement policy interface.
+ * admit : page is newly loaded into frame.
+ * access : page already in buffer is accessed again.
+ * For ACCESS_SCAN, admit puts page where it is evicted first,
+ * and access doesn't make page hotter.
+ * remove : frame is released without eviction (e.g. close_table).
+ * victim : choose unpinned frame to evict and detach it from policy.
+ *			If every frame is pinned, return NULL.
+ * cold_pages : fill up to max unpinned frames which are evicted next,
+ *			coldest first. Return the number of frames.
+ * resize : frames of partition are added or removed.
+ * hot_pages : fill up to max resident frames, hottest first.
+ *			Return the number of frames.
+ * reinsert : put back page taken by victim as it was,
+ *			without counting it as access.
+ */
+typedef struct replacer {
+	void (*init)(buf_partition * p);
+	void (*destroy)(buf_partition * p);
+	void (*admit)(buf_partition * p, Buf * b, ACCESS_TYPE type);
+	void (*access)(buf_partition * p, Buf * b, ACCESS_TYPE type);
+	void (*remove)(buf_partition * p, Buf * b);
+	Buf * (*victim)(buf_partition * p);
+	int (*cold_pages)(buf_partition * p, Buf ** out, int max);
+	void (*resize)(buf_partition * p);
+	int (*hot_pages)(buf_partition * p, Buf ** out, int max);
+	void (*reinsert)(buf_partition * p, Buf * b);
+} replacer;
+
+// Options given at init_db time.
+typedef struct db_config {
+	POLICY_TYPE policy;
+	bool page_cleaner;		// Run background page cleaner.
+	int cleaner_interval;	// Sleep time of page cleaner (ms).
+	int num_partitions;		// Number of buffer pool partitions.
+	bool huge_pages;		// Back frame arena with transparent huge pages.
+	int max_frames;			// Max size of pool by resize_buffer_pool. 0 is default.
+	bool warmup;			// Save resident pages and read them again after restart.
+	int checkpoint_interval;	// Time between checkpoints (ms). 0 checkpoints only at close and shutdown.
+	int readahead_pages;	// Number of leaf pages read ahead of leaf chain scan. 0 disables read-ahead.
+	IO_TYPE io_backend;		// Backend of page reads and writes.
+	DURABILITY_TYPE durability;
+	int page_size;			// 4, 8, 16 or 32 KB. It must be page size of tables.
+} db_config;
+
+/* Header fields of opened table kept in memory.
+ * Tree reads them without header page. They are changed under
+ * write latch of table, and stored to header page at checkpoint.
+ */
+typedef struct table_desc {
+	int64_t root_page;
+	int64_t free_page;
+	int64_t num_pages;
+	bool dirty;				// Changed after it was stored to header page.
+} table_desc;
+
+/* Buffer pool quota of table given at open_table time.
+ * Reserved frames and max share are divided among partitions.
+ */
+typedef struct table_quota {
+	int min_frames;			// Frames reserved for table. Other tables don't evict its pages under it.
+	int max_percent;		// Max share of buffer pool (%). Over it, table evicts its own pages.
+	PRIORITY_TYPE priority;
+} table_quota;
+
+// Page saved for warm-up.
+typedef struct warm_page {
+	int64_t page_offset;
+	int table_id;
+} warm_page;
+
+// Read or write of contiguous pages given to I/O backend.
+typedef struct io_request {
+	int table_id;
+	int64_t offset;
+	struct iovec * iov;		// One iovec for each page.
+	int num;				// Number of iovec.
+	bool write;
+	ssize_t result;			// Bytes read or written, or negative errno.
+} io_request;
+
+/* I/O backend.
+ * submit does every request of batch and returns
+ * after all of them complete. It returns 0 if all succeed.
+ */
+typedef struct io_backend {
+	int (*init)(void);
+	void (*destroy)(void);
+	int (*submit)(io_request * reqs, int num);
+} io_backend;
+
+// Leaf pages read-ahead thread is asked to read.
+typedef struct readahead_req {
+	int table_id;
+	int64_t offset;			// First leaf page.
+	int num;				// Number of leaf pages following leaf chain.
+	bool contiguous;		// Right sibling of last leaf was next page in file.
+} readahead_req;
+
+// Leaf chain access of table seen by read-ahead.
+typedef struct readahead_state {
+	int64_t next_leaf;		// Right sibling of last leaf read.
+	int countdown;			// Sequential leaves until next request.
+} readahead_state;
+
 /* Type representing the pages.
  * There are 4 types of page. 
  * Header page is special and containing meta data.
  * Free page is maintained by free page list.
  * Leaf page is containing records.
  * Internal page is indexing internal or leaf page.
- * All page are 4096 bytes.
+ * All page are page_size bytes. Page size is saved in header page,
+ * and number of records in page is derived from it.
  */
 
 
@@ -148,25 +396,37 @@ typedef struct header_page {
 	int64_t root_page;
 	int64_t num_pages;
 	int64_t page_lsn;
-	int64_t reserved[508];
+	int64_t page_size;	// 0 in table made before page size was saved. It is 4096.
+	int64_t left_linked;	// 0 in table made before leaves had left sibling.
+	int64_t leaf_format;	// 0 in table made before leaves were LEAF_SPLIT.
 } header_page;
 
 typedef struct free_page {
 	int64_t  next_page;
-	char unused[4088];
 } free_page;
 
+/* Keys of leaf are kept together, so search reads only keys.
+ * Value of i-th key is in value cell slots[i]. Slot array holds
+ * every cell, and cells after num_keys are free, so insert and
+ * delete move only keys and slots.
+ * Slot array is in header for small pages, otherwise after keys.
+ * Page made before has leaf_record array after header and format 0.
+ */
 typedef struct leaf_page {
 	int64_t parent_page;
 	int is_leaf;
 	int num_keys;
-	int64_t padding;
+	int64_t left_sibling;	// 0 for first leaf.
 	int64_t page_lsn;	// log
-	int64_t reserved[11];
+	int64_t format;		// LEAF_SPLIT.
+	uint8_t slots[LEAF_HEADER_SLOTS];
 	int64_t right_sibling;
-	leaf_record records[31];
+	int64_t keys[];		// leaf_order - 1 keys, then slots and values.
 } leaf_page;
 
+#define LEAF_SLOTS(leaf)	((uint8_t *)(leaf) + leaf_slot_offset)
+#define LEAF_VALUE(leaf, i)	((char *)(leaf) + leaf_value_offset + LEAF_SLOTS(leaf)[i] * VALUE_SIZE)
+
 typedef struct internal_page {
 	int64_t parent_page;
 	int is_leaf;
@@ -175,18 +435,85 @@ typedef struct internal_page {
 	int64_t page_lsn;	// log	
 	int64_t reserved[11];
 	int64_t one_more_page;
-	internal_record records[248];
+	internal_record records[];	// internal_order - 1 records.
 } internal_page;
 
 #pragma pack(pop)
 
+/* Source of bulk load.
+ * Put next record into key and value and return 0.
+ * If there is no more record, return -1.
+ */
+typedef int (*bulk_iterator)(void * arg, int64_t * key, char * value);
+
+/* Range scan over leaf chain. Keys in [lower, upper] are returned
+ * in ascending order, or in descending order by reverse cursor.
+ * Only leaf under cursor is pinned.
+ */
+typedef struct cursor {
+	int table_id;
+	Buf * b;			// Pinned leaf. NULL for mapped table.
+	leaf_page * leaf;	// Leaf under cursor.
+	int index;			// Next record in leaf.
+	int64_t lower;
+	int64_t upper;
+	bool reverse;		// Follow left siblings.
+	bool prefetch;		// Ask next sibling to be read ahead.
+	bool done;
+} cursor;
+
 // FUNCTION PROTOTYPES.
 
-Buf * buf;
-LRU_LIST * LRU_list;
+Buf * buf;				// Frame descriptors. buf[i] describes frame_arena[i].
 int num_buf;
+int max_buf;			// Number of frames reserved in frame_arena.
+char * frame_arena;		// Page-aligned memory of every frame.
+size_t arena_size;
+LRU * lru_nodes;
+db_config config;
+replacer * policy;
+buf_partition * partitions;
+int num_partitions;
+pthread_mutex_t cleaner_latch;
+pthread_cond_t cleaner_cond;	// Wakes page cleaner up when it is stopped.
+pthread_t cleaner_thread;
+bool cleaner_running;
+int page_size;			// Set by init_db and fixed until shutdown_db.
+int leaf_order;
+int leaf_slot_offset;	// Offset of slot array in leaf.
+int leaf_value_offset;	// Offset of first value cell in leaf.
+int internal_order;
+int join_result_size;	// Number of values in output page of join.
+int log_size;			// Size of log record. It has old and new page.
+pthread_rwlock_t table_latch[11];	// Readers are find and join, writers modify tree.
+io_backend * io;
+int64_t table_bytes_read[11];		// Changed atomically by I/O backend.
+int64_t table_bytes_written[11];
+table_desc descs[11];
+table_quota quotas[11];		// Changed under latches of every partition.
+int num_quotas;				// Number of tables whose quota is not default.
+
+// WARM-UP
+warm_page * warm_list;
+int num_warm;
+pthread_t warm_thread;
+bool warm_running;
+bool warm_pending[11];		// Tables waiting for warm-up.
+pthread_mutex_t warm_latch;
+pthread_cond_t warm_cond;
+
+// READ-AHEAD
+readahead_req ra_queue[READAHEAD_QUEUE];
+int ra_head;
+int ra_num;
+readahead_state ra_state[11];
+pthread_t ra_thread;
+bool ra_running;
+pthread_mutex_t ra_latch;		// Protects queue and state of read-ahead.
+pthread_cond_t ra_cond;
 
 // LOG
+pthread_mutex_t log_latch;		// Protects log buffer and transaction state.
 Log * log_buf;
 int64_t flushed_lsn;
 int flushed_num;
@@ -194,50 +521,161 @@ int end_num;
 int trx_id;
 int log_fd;
 bool trx;
+bool recovering;			// Tables are opened by redo of recovery.
 int table[11];
+char * table_map[11];			// Mapping of table opened by TABLE_MMAP, otherwise NULL.
+int64_t table_map_size[11];
 
 // OPEN AND INIT
 int cut(int length);
 int open_table(char* pathname);
+int open_table_with_mode(char * pathname, TABLE_MODE mode);
+int open_table_with_quota(char * pathname, table_quota * quota);
+Page * map_page(int table_id, int64_t offset);
+leaf_page * find_mapped_leaf(int table_id, int64_t key);
 Buf * get_buf(int table_id, int64_t offset);
-Buf * find_buf(int table_id, int64_t offset);
-Buf * make_buf(int table_id, int64_t offset);
+Buf * get_buf_scan(int table_id, int64_t offset);
+Buf * get_buf_access(int table_id, int64_t offset, ACCESS_TYPE type);
+Buf * find_buf(buf_partition * p, int table_id, int64_t offset, ACCESS_TYPE type);
+Buf * make_buf(buf_partition * p, int table_id, int64_t offset, ACCESS_TYPE type);
 void read_page(int table_id, Page * page, int64_t size, int64_t offset);
 void write_page(int table_id, Page * page, int64_t size, int64_t offset);
+int read_pages(int table_id, struct iovec * iov, int num, int64_t offset);
 
 // BUFFER POOL
 int init_db(int num_buf);
-Buf * read_headerpage(int table_id);
-Buf * register_header_LRU(Buf * hb);
+void default_db_config(db_config * config);
+int init_db_with_config(int num_buf, db_config * config);
+int set_page_size(int size);
+int resize_buffer_pool(int num);
+buf_partition * get_partition(int table_id, int64_t offset);
+Buf * read_headerpage(buf_partition * p, int table_id);
 void init_buf(int i);
-void init_LRU(void);
-int update_LRU(Buf * b);
-void make_victim(void);
-int get_free_buffer_index(void);
-void alloc_freepage(int table_id, Buf * hb, int64_t offset);
+int alloc_frame_arena(int num);
+void free_frame_arena(void);
+void touch_buf(Buf * b, ACCESS_TYPE type);
+void make_victim(buf_partition * p, int table_id);
+int get_free_buffer_index(buf_partition * p, int table_id);
+void push_free_frame(buf_partition * p, int i);
+int reserve_frame(int table_id, int64_t offset, bool evict, Buf ** b);
+void complete_frame(Buf * b, ACCESS_TYPE type);
+void cancel_frame(Buf * b);
+void alloc_freepage(int table_id, int64_t offset);
 Buf * init_headerpage (int table_id);
+void load_table_desc(int table_id, header_page * hp);
+void store_table_desc(int table_id);
 void mark_dirty(Buf * b);
 void release_pincount(Buf * b);
+int flush_dirty_pages(int table_id);
+int sync_flags(void);
+void sync_table(int table_id);
+void sync_tables(void);
+int checkpoint(void);
 int close_table(int table_id);
+void drop_table_pages(int table_id);
 int shutdown_db(void);
+void unmap_buf(Buf * b);
+
+// TABLE QUOTA
+void default_table_quota(table_quota * quota);
+int set_table_quota(int table_id, table_quota * quota);
+// STATISTICS
+void get_db_stats(db_stats * stats);
+void reset_db_stats(void);
+void print_db_stats(void);
+
+// PAGE CLEANER
+void start_page_cleaner(void);
+void stop_page_cleaner(void);
+void * page_cleaner(void * arg);
+int clean_pages(void);
+
+// WARM-UP
+int save_warm_pages(void);
+void load_warm_list(void);
+void * warmup(void * arg);
+void request_warmup(int table_id);
+void start_warmup(void);
+void stop_warmup(void);
+
+// READ-AHEAD
+int readahead_window(void);
+void readahead_hint(int table_id, Buf * b, ACCESS_TYPE type);
+void request_readahead(int table_id, int64_t offset, int num, bool contiguous);
+void reset_readahead(int table_id);
+void * readahead(void * arg);
+void start_readahead(void);
+void stop_readahead(void);
+
+// REPLACEMENT POLICY
+replacer * get_replacer(POLICY_TYPE type);
+
+// I/O BACKEND
+io_backend * get_io_backend(IO_TYPE type);
+void init_io(void);
+void destroy_io(void);
+int submit_io(int table_id, struct iovec * iov, int num, int64_t offset, bool write);
+
+// PAGE TABLE
+void init_page_hash(page_hash * h, int num);
+void free_page_hash(page_hash * h);
+int hash_lookup(page_hash * h, int table_id, int64_t offset);
+void hash_insert(page_hash * h, int table_id, int64_t offset, int frame);
+void hash_remove(page_hash * h, int table_id, int64_t offset);
+void rehash_page_hash(page_hash * h, int num);
+
+// SEARCH
+void init_search(void);
+int search_internal(internal_page * page, int64_t key);
+int search_leaf(leaf_page * page, int64_t key);
 
 // FIND
 Buf * find_leaf(int table_id, int64_t key);
+Buf * find_leaf_bound(int table_id, int64_t key, int64_t * bound, bool * bounded);
 char * find(int table_id, int64_t key);
+int find_record(int table_id, int64_t key, char * value);
+int find_in_leaf(leaf_page * leaf, int64_t key);
 
 // INSERT
 int insert(int table_id, int64_t key, char * value);
+int upsert(int table_id, int64_t key, char * value);
+int put_record(int table_id, int64_t key, char * value, bool overwrite);
 int insert_into_leaf(Buf * b, int64_t key, char * value);
 int insert_into_leaf_after_splitting(int table_id, Buf * b, int64_t key, char * value);
+void set_left_sibling(int table_id, int64_t offset, int64_t left);
 int insert_into_parent(int table_id, Buf * left_b, int64_t key, Buf * right_b);
 int insert_into_new_root(int table_id, Buf * left_b, int64_t key, Buf * right_b);
 int get_left_index(Buf * b, Buf * left_b);
 int insert_into_internal(Buf * b, int left_index, int64_t key, Buf * right_b);
 int insert_into_internal_after_splitting(int table_id, Buf * b, int left_index, int64_t key, Buf * right_b);
 
+// BULK LOAD
+int bulk_load(int table_id, bulk_iterator next, void * arg, int fill_factor);
+
+// BATCH
+int insert_batch(int table_id, leaf_record * records, int num);
+int delete_batch(int table_id, int64_t * keys, int num);
+
+// CURSOR
+int open_cursor(cursor * c, int table_id, int64_t lower, int64_t upper, bool prefetch);
+int open_reverse_cursor(cursor * c, int table_id, int64_t lower, int64_t upper, bool prefetch);
+int cursor_next(cursor * c, int64_t * key, char * value);
+int cursor_next_batch(cursor * c, leaf_record * records, int max);
+void close_cursor(cursor * c);
+void link_leaves(int table_id);
+
+// LEAF
+void init_leaf(leaf_page * leaf);
+void insert_into_leaf_at(leaf_page * leaf, int i, int64_t key, char * value);
+void remove_from_leaf_at(leaf_page * leaf, int i);
+void get_leaf_record(leaf_page * leaf, int i, leaf_record * record);
+void set_leaf_records(leaf_page * leaf, leaf_record * records, int num);
+void convert_leaves(int table_id);
+
 // DELETE
 int delete(int table_id, int64_t key);
 int delete_entry(int table_id, Buf * b, int64_t key);
+int balance_page(int table_id, Buf * b);
 Buf * remove_entry_from_page(Buf * b, int64_t key);
 int adjust_root(int table_id, Buf * b);
 int get_neighbor_index(int table_id, Buf * b);
@@ -247,7 +685,7 @@ int redistribute_pages(int table_id, Buf * b, Buf * nb, int neighbor_index, int
 
 // JOIN
 int join_table(int table_id_1, int table_id_2, char * pathname);
-Buf * get_first_leafpage(int table_id);
+leaf_page * get_first_leafpage(int table_id, Buf ** b);
 Buf * make_outbuffer(void);
 int push_resultpage(FILE * fp, result_page * rp, leaf_page * l1, leaf_page * l2, int num_key_1, int num_key_2, int num_result);
 void flush_resultpage(FILE * fp, result_page * rp, int num_result);
@@ -258,12 +696,14 @@ void create_log_buf(void);
 int create_log(Buf * b, LOG_TYPE type);
 int complete_log(Buf * b, LOG_TYPE type);
 void flush_log(int num);
-void init_log(void);
-void recovery_from_file(void);
+int init_log(void);
+int recovery_from_file(void);
 void rollback(int64_t lsn);
 int begin_transaction(void);
 int commit_transaction(void);
 int abort_transaction(void);
+int update(int table_id, int64_t key, char * value);
+int update_record(Buf * b, int i, char * value);
 int create_undo(Buf * b, log_header * redo);
 
 
@@ -0,0 +1,247 @@
+/**
+ *		@class Database System
+ *		@file  batch.c
+ *		@brief Batched insert and delete
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+/* Batch is sorted, and keys of one leaf are applied together.
+ * Tree is descended once for each leaf, not for each key.
+ * Leaf is changed by one log record, and it is split or
+ * merged at most once however many keys go into it.
+ */
+
+static int compare_record(const void * a, const void * b) {
+	const leaf_record * x = *(leaf_record * const *)a;
+	const leaf_record * y = *(leaf_record * const *)b;
+
+	if (x->key != y->key)
+		return x->key < y->key ? -1 : 1;
+	// Earlier record of same key comes first and is kept.
+	return x < y ? -1 : x > y;
+}
+
+static int compare_key(const void * a, const void * b) {
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// Copy records [from, to) of merged into leaf.
+static void fill_leaf(leaf_page * leaf, leaf_record * merged, int from, int to) {
+	set_leaf_records(leaf, &merged[from], to - from);
+}
+
+/* Insert sorted records which are not in leaf of b.
+ * If they don't fit, leaf is split once into as many
+ * leaves as needed, and records are spread evenly.
+ * b is released.
+ */
+static int insert_into_leaf_batch(int table_id, Buf * b, leaf_record ** recs, int num) {
+	Buf * prev_b, * new_b;
+	leaf_page * leaf, * prev, * new_leaf;
+	leaf_record * merged;
+	uint8_t * slots, cells[MAX_LEAF_ORDER];
+	int i, j, k, total, pieces, p;
+	int64_t right, last;
+
+	leaf = (leaf_page *)b->page;
+	total = leaf->num_keys + num;
+
+	// Case : leaf has room for all records.
+	if (total <= leaf_order - 1) {
+		if (trx)
+			leaf->page_lsn = create_log(b, UPDATE);
+		// Merge from the end, so keys are moved once.
+		// New records take free cells, which are slots after num_keys.
+		slots = LEAF_SLOTS(leaf);
+		memcpy(cells, &slots[leaf->num_keys], num);
+		i = leaf->num_keys - 1;
+		for (j = num - 1, k = total - 1; j >= 0; k--) {
+			if (i >= 0 && leaf->keys[i] > recs[j]->key) {
+				leaf->keys[k] = leaf->keys[i];
+				slots[k] = slots[i--];
+			} else {
+				leaf->keys[k] = recs[j]->key;
+				slots[k] = cells[j];
+				memcpy(LEAF_VALUE(leaf, k), recs[j--]->value, VALUE_SIZE);
+			}
+		}
+		leaf->num_keys = total;
+		if (trx)
+			complete_log(b, UPDATE);
+		mark_dirty(b);
+		release_pincount(b);
+		return 0;
+	}
+
+	// Case : leaf must be split.
+	merged = (leaf_record *)malloc(sizeof(leaf_record) * total);
+	for (i = 0, j = 0, k = 0; k < total; k++) {
+		if (j == num || (i < leaf->num_keys && leaf->keys[i] < recs[j]->key))
+			get_leaf_record(leaf, i++, &merged[k]);
+		else
+			merged[k] = *recs[j++];
+	}
+
+	pieces = (total + leaf_order - 2) / (leaf_order - 1);
+	fill_leaf(leaf, merged, 0, total / pieces);
+	mark_dirty(b);
+
+	right = leaf->right_sibling;
+	prev_b = b;
+	last = b->page_offset;
+	for (p = 1; p < pieces; p++) {
+		prev = (leaf_page *)prev_b->page;
+		new_b = get_buf(table_id, descs[table_id].free_page);
+		new_leaf = (leaf_page *)new_b->page;
+		fill_leaf(new_leaf, merged, (int64_t)p * total / pieces, (int64_t)(p + 1) * total / pieces);
+		new_leaf->is_leaf = 1;
+		new_leaf->parent_page = prev->parent_page;
+		new_leaf->right_sibling = prev->right_sibling;
+		new_leaf->left_sibling = prev_b->page_offset;
+		prev->right_sibling = new_b->page_offset;
+		mark_dirty(new_b);
+		last = new_b->page_offset;
+
+		// insert_into_parent releases both pages, but new leaf is left of next one.
+		if (p < pieces - 1)
+			get_buf(table_id, new_b->page_offset);
+		insert_into_parent(table_id, prev_b, new_leaf->keys[0], new_b);
+		prev_b = new_b;
+	}
+	set_left_sibling(table_id, right, last);
+	free(merged);
+	return 0;
+}
+
+/* Insert records of batch.
+ * Record whose key is already in table, or comes earlier
+ * in batch, is skipped.
+ * Return the number of inserted records, or -1 if table is read only.
+ */
+int insert_batch(int table_id, leaf_record * records, int num) {
+	Buf * b;
+	leaf_record ** sorted;
+	int64_t bound;
+	bool bounded, first;
+	int i, j, n, inserted;
+	int64_t last;
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table_map[table_id] != NULL) {
+		printf("insert_batch() error : table %d is read only\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+
+	sorted = (leaf_record **)malloc(sizeof(leaf_record *) * (num + 1));
+	for (i = 0; i < num; i++)
+		sorted[i] = &records[i];
+	qsort(sorted, num, sizeof(leaf_record *), compare_record);
+
+	inserted = 0;
+	first = true;
+	last = 0;
+	for (i = 0; i < num; i = j) {
+		b = find_leaf_bound(table_id, sorted[i]->key, &bound, &bounded);
+
+		// Records of this leaf are packed to sorted[i .. i + n).
+		n = 0;
+		for (j = i; j < num && (!bounded || sorted[j]->key < bound); j++) {
+			if ((!first && sorted[j]->key == last) ||
+					find_in_leaf((leaf_page *)b->page, sorted[j]->key) >= 0) {
+				first = false;
+				last = sorted[j]->key;
+				continue;
+			}
+			first = false;
+			last = sorted[j]->key;
+			sorted[i + n++] = sorted[j];
+		}
+
+		if (n > 0)
+			insert_into_leaf_batch(table_id, b, &sorted[i], n);
+		else
+			release_pincount(b);
+		inserted += n;
+	}
+
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	free(sorted);
+	return inserted;
+}
+
+/* Delete keys of batch.
+ * Keys of one leaf are removed together, and then
+ * leaf is coalesced or redistributed once.
+ * Return the number of deleted keys, or -1 if table is read only.
+ */
+int delete_batch(int table_id, int64_t * keys, int num) {
+	Buf * b;
+	leaf_page * leaf;
+	int64_t * sorted, bound;
+	bool bounded;
+	uint8_t * slots, cells[MAX_LEAF_ORDER];
+	int i, j, r, k, found, deleted;
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table_map[table_id] != NULL) {
+		printf("delete_batch() error : table %d is read only\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+
+	sorted = (int64_t *)malloc(sizeof(int64_t) * (num + 1));
+	memcpy(sorted, keys, sizeof(int64_t) * num);
+	qsort(sorted, num, sizeof(int64_t), compare_key);
+
+	deleted = 0;
+	for (i = 0; i < num; i = j) {
+		b = find_leaf_bound(table_id, sorted[i], &bound, &bounded);
+		leaf = (leaf_page *)b->page;
+
+		found = 0;
+		for (j = i; j < num && (!bounded || sorted[j] < bound); j++)
+			if ((j == i || sorted[j] != sorted[j - 1]) && find_in_leaf(leaf, sorted[j]) >= 0)
+				found++;
+		if (found == 0) {
+			release_pincount(b);
+			continue;
+		}
+
+		// Remove keys in one pass over leaf.
+		// Cells of removed keys become free, after kept ones.
+		if (trx)
+			leaf->page_lsn = create_log(b, UPDATE);
+		slots = LEAF_SLOTS(leaf);
+		for (r = 0, k = 0, j = i; r < leaf->num_keys; r++) {
+			while (j < num && sorted[j] < leaf->keys[r])
+				j++;
+			if (j < num && sorted[j] == leaf->keys[r]) {
+				cells[r - k] = slots[r];
+				continue;
+			}
+			leaf->keys[k] = leaf->keys[r];
+			slots[k++] = slots[r];
+		}
+		memcpy(&slots[k], cells, leaf->num_keys - k);
+		leaf->num_keys = k;
+		if (trx)
+			complete_log(b, UPDATE);
+		mark_dirty(b);
+		deleted += found;
+
+		balance_page(table_id, b);
+		for (j = i; j < num && (!bounded || sorted[j] < bound); j++)
+			;
+	}
+
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	free(sorted);
+	return deleted;
+}
@@ -20,12 +20,21 @@ int cut (int length) {
 
 // Read page from file
 void read_page(int table_id, Page * page, int64_t size, int64_t offset) {
-	pread(table[table_id], page, size, offset);
+	struct iovec iov = { page, size };
+	submit_io(table_id, &iov, 1, offset, false);
 }
 
 // Write page to file
 void write_page(int table_id, Page * page, int64_t size, int64_t offset) {
-	pwrite(table[table_id], page, size, offset);
+	struct iovec iov = { page, size };
+	submit_io(table_id, &iov, 1, offset, true);
+}
+
+/* Read contiguous pages from file into separate frames at once.
+ * If every page is read, return 0. Otherwise, return -1.
+ */
+int read_pages(int table_id, struct iovec * iov, int num, int64_t offset) {
+	return submit_io(table_id, iov, num, offset, false);
 }
 
 // FIND < KEY >
@@ -33,55 +42,130 @@ void write_page(int table_id, Page * page, int64_t size, int64_t offset) {
 /* Find Buf pointer of leaf page which has key.
  */
 Buf * find_leaf(int table_id, int64_t key) {
+	return find_leaf_bound(table_id, key, NULL, NULL);
+}
+
+/* find_leaf which also gives upper bound of keys of the leaf.
+ * Keys >= *bound belong to leaves on the right.
+ * If leaf is the rightmost one, *bounded is false.
+ */
+Buf * find_leaf_bound(int table_id, int64_t key, int64_t * bound, bool * bounded) {
 	int i;
-	Buf * hb;
-	header_page * hp;
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
 
-	Buf * b = get_buf(table_id, hp->root_page);
+	Buf * b = get_buf(table_id, descs[table_id].root_page);
 	internal_page * c = (internal_page *) b->page;
 
+	int64_t child;
+
+	if (bounded != NULL)
+		*bounded = false;
 	while (!c->is_leaf) {
 		//printf("%lld\n", b->page_offset);
-		release_pincount(b);
-		i = 0;
-		while (i < c->num_keys) {
-			if (key >= c->records[i].key)
-				i++;
-			else
-				break;
-		}
-		if (i == 0) {
-			b = get_buf(table_id, c->one_more_page);
-			c = (internal_page *) b->page;
-		} else {
-			b = get_buf(table_id, c->records[i - 1].page_offset);
-			c = (internal_page *) b->page;
+		i = search_internal(c, key);
+		if (i == 0)
+			child = c->one_more_page;
+		else
+			child = c->records[i - 1].page_offset;
+		// Separator of lower page is tighter.
+		if (bound != NULL && i < c->num_keys) {
+			*bound = c->records[i].key;
+			*bounded = true;
 		}
+		// Page may be evicted after it is released.
+		release_pincount(b);
+		b = get_buf(table_id, child);
+		c = (internal_page *) b->page;
 	}
 
-	release_pincount(hb);
 	return b;
 }
 
+/* Page of table opened by TABLE_MMAP.
+ * It points into mapping, so it is neither pinned nor copied.
+ * If offset is out of file, return NULL.
+ */
+Page * map_page(int table_id, int64_t offset) {
+	if (offset < 0 || offset + page_size > table_map_size[table_id])
+		return NULL;
+	return (Page *)(table_map[table_id] + offset);
+}
+
+// find_leaf of table opened by TABLE_MMAP.
+leaf_page * find_mapped_leaf(int table_id, int64_t key) {
+	int i;
+	header_page * hp;
+	internal_page * c;
+
+	if ((hp = (header_page *)map_page(table_id, HEADERPAGE_OFFSET)) == NULL)
+		return NULL;
+	c = (internal_page *)map_page(table_id, hp->root_page);
+
+	while (c != NULL && !c->is_leaf) {
+		i = search_internal(c, key);
+		if (i == 0)
+			c = (internal_page *)map_page(table_id, c->one_more_page);
+		else
+			c = (internal_page *)map_page(table_id, c->records[i - 1].page_offset);
+	}
+	return (leaf_page *)c;
+}
+
 /* Finds and returns the record to which
  * a key refers.
+ * Value is copied, because page may be evicted
+ * after find returns. Caller frees it.
  */
 char * find(int table_id, int64_t key) {
-	int i;
-	Buf * b = find_leaf(table_id, key);
-	leaf_page * leaf = (leaf_page *) b->page;
-	release_pincount(b);
-	if (b->page_offset == 0) return NULL;
-	for (i = 0; i < leaf->num_keys; i++) {
-		if (leaf->records[i].key == key) break;
+	char * value;
+
+	value = (char *)malloc(VALUE_SIZE);
+	pthread_rwlock_rdlock(&table_latch[table_id]);
+	if (find_record(table_id, key, value) != 0) {
+		free(value);
+		value = NULL;
 	}
-	if (i == leaf->num_keys)
-		return NULL;
-	else {
-		return (char *) leaf->records[i].value;
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	return value;
+}
+
+/* find without table latch.
+ * Caller holds table latch.
+ * If key exists, copy its value unless value is NULL and return 0.
+ * Otherwise, return -1.
+ */
+int find_record(int table_id, int64_t key, char * value) {
+	int i, result;
+	Buf * b = NULL;
+	leaf_page * leaf;
+
+	// Mapped table doesn't use buffer pool.
+	if (table_map[table_id] != NULL) {
+		leaf = find_mapped_leaf(table_id, key);
+	} else {
+		b = find_leaf(table_id, key);
+		leaf = (leaf_page *) b->page;
 	}
+
+	result = -1;
+	if (leaf != NULL && (b == NULL || b->page_offset != 0)) {
+		if ((i = find_in_leaf(leaf, key)) >= 0) {
+			if (value != NULL)
+				memcpy(value, LEAF_VALUE(leaf, i), VALUE_SIZE);
+			result = 0;
+		}
+	}
+	if (b != NULL)
+		release_pincount(b);
+	return result;
+}
+
+// Index of key in leaf. If leaf doesn't have key, return -1.
+int find_in_leaf(leaf_page * leaf, int64_t key) {
+	int i = search_leaf(leaf, key);
+
+	if (i < leaf->num_keys && leaf->keys[i] == key)
+		return i;
+	return -1;
 }
 
 // INSERT <KEY> <VALUE>
@@ -94,24 +178,14 @@ int insert_into_leaf(Buf * b, int64_t key, char * value) {
 
 	//printf("insert_into_leaf : %ld \n", key);
 
-	int i, insertion_point;
+	int insertion_point;
 	leaf_page * leaf = (leaf_page *) b->page;
 
 	if (trx)
 		leaf->page_lsn = create_log(b, UPDATE);
 	
-	insertion_point = 0;
-	while (insertion_point < leaf->num_keys && leaf->records[insertion_point].key < key)
-		insertion_point++;
-
-	for (i = leaf->num_keys; i > insertion_point; i--) {
-		leaf->records[i].key = leaf->records[i - 1].key;
-		memcpy(leaf->records[i].value, leaf->records[i - 1].value, VALUE_SIZE);
-	}
-
-	leaf->records[insertion_point].key = key;
-	memcpy(leaf->records[insertion_point].value, value, VALUE_SIZE);
-	leaf->num_keys++;
+	insertion_point = search_leaf(leaf, key);
+	insert_into_leaf_at(leaf, insertion_point, key, value);
 
 	if (trx)
 		complete_log(b, UPDATE);
@@ -131,57 +205,38 @@ int insert_into_leaf_after_splitting(int table_id, Buf * b, int64_t key, char *
 
 	//printf("insert_into_leaf_after_splitting : %ld \n", key);
 	
-	Buf * new_b, * hb;
-	int insertion_index, split, new_key, i, j;
+	Buf * new_b;
+	int insertion_index, split, i, j;
+	int64_t new_key;
 	leaf_page * leaf, * new_leaf;
-	header_page * hp;
-	int temp_keys[LEAF_ORDER];
-	char temp_values[LEAF_ORDER][VALUE_SIZE];
-
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
-	release_pincount(hb);
+	leaf_record temp[MAX_LEAF_ORDER];
 
-	new_b = get_buf(table_id, hp->free_page);
+	new_b = get_buf(table_id, descs[table_id].free_page);
 	new_leaf = (leaf_page *)new_b->page;
 
-	insertion_index = 0;
 	leaf = (leaf_page *) b->page;
-
-	while (insertion_index < LEAF_ORDER - 1 && leaf->records[insertion_index].key < key)
-		insertion_index++;
+	insertion_index = search_leaf(leaf, key);
 
 	for (i = 0, j = 0; i < leaf->num_keys; i++, j++) {
 		if (j == insertion_index) j++;
-		temp_keys[j] = leaf->records[i].key;
-		memcpy(temp_values[j], leaf->records[i].value, VALUE_SIZE);
+		get_leaf_record(leaf, i, &temp[j]);
 	}
 
-	temp_keys[insertion_index] = key;
-	memcpy(temp_values[insertion_index], value, VALUE_SIZE);
-
-	leaf->num_keys = 0;
-	new_leaf->num_keys = 0;
+	temp[insertion_index].key = key;
+	memcpy(temp[insertion_index].value, value, VALUE_SIZE);
 
-	split = cut(LEAF_ORDER);
-
-	for (i = 0; i < split; i++) {
-		memcpy(leaf->records[i].value, temp_values[i], VALUE_SIZE);
-		leaf->records[i].key = temp_keys[i];
-		leaf->num_keys++;
-	}
+	split = cut(leaf_order);
 
-	for (i = split, j = 0; i < LEAF_ORDER; i++, j++) {
-		memcpy(new_leaf->records[j].value, temp_values[i], VALUE_SIZE);
-		new_leaf->records[j].key = temp_keys[i];
-		new_leaf->num_keys++;
-	}
+	set_leaf_records(leaf, temp, split);
+	set_leaf_records(new_leaf, &temp[split], leaf_order - split);
 
 	new_leaf->right_sibling = leaf->right_sibling;
+	new_leaf->left_sibling = b->page_offset;
 	leaf->right_sibling = new_b->page_offset;
+	set_left_sibling(table_id, new_leaf->right_sibling, new_b->page_offset);
 	new_leaf->parent_page = leaf->parent_page;
 	new_leaf->is_leaf = 1;
-	new_key = new_leaf->records[0].key;
+	new_key = new_leaf->keys[0];
 
 	// Write to disk
 	mark_dirty(b);
@@ -190,6 +245,18 @@ int insert_into_leaf_after_splitting(int table_id, Buf * b, int64_t key, char *
 	return insert_into_parent(table_id, b, new_key, new_b);
 }
 
+// Set left sibling of leaf at offset. Offset 0 is end of leaf chain.
+void set_left_sibling(int table_id, int64_t offset, int64_t left) {
+	Buf * b;
+
+	if (offset == 0)
+		return;
+	b = get_buf(table_id, offset);
+	((leaf_page *)b->page)->left_sibling = left;
+	mark_dirty(b);
+	release_pincount(b);
+}
+
 /* Inserts a new key and page_offset into internal page
  * causing the page's size to exceed
  * the INTERNAL_OREDER, and causing the page to split into two.
@@ -200,16 +267,11 @@ int insert_into_internal_after_splitting(int table_id, Buf * b, int left_index,
 	//printf("insert_into_internal_after_splitting : %ld \n", key);
 
 	int i, j, split, k_prime;
-	Buf * new_b, * child_b, * hb;
+	Buf * new_b, * child_b;
 	internal_page * new_page, * child;
 	internal_page * old_page, right;
-	header_page * hp;
-	int64_t temp_keys[INTERNAL_ORDER];
-	int64_t temp_pageoffset[INTERNAL_ORDER];
-
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
-	release_pincount(hb);
+	int64_t temp_keys[MAX_INTERNAL_ORDER];
+	int64_t temp_pageoffset[MAX_INTERNAL_ORDER];
 
 	old_page = (internal_page *)b->page;
 
@@ -221,9 +283,9 @@ int insert_into_internal_after_splitting(int table_id, Buf * b, int left_index,
 	temp_pageoffset[left_index] = right_b->page_offset;
 	temp_keys[left_index] = key;
 
-	split = cut (INTERNAL_ORDER);
+	split = cut (internal_order);
 
-	new_b = get_buf(table_id, hp->free_page);
+	new_b = get_buf(table_id, descs[table_id].free_page);
 	new_page = (internal_page *)new_b->page;
 	new_page->is_leaf = false;
 	new_page->num_keys = 0;
@@ -238,7 +300,7 @@ int insert_into_internal_after_splitting(int table_id, Buf * b, int left_index,
 	new_page->one_more_page = temp_pageoffset[split];
 	k_prime = temp_keys[split];
 
-	for (++i, j = 0; i < INTERNAL_ORDER; i++, j++) {
+	for (++i, j = 0; i < internal_order; i++, j++) {
 		new_page->records[j].page_offset = temp_pageoffset[i];
 		new_page->records[j].key = temp_keys[i];
 		new_page->num_keys++;
@@ -331,16 +393,12 @@ int insert_into_parent(int table_id, Buf * left_b, int64_t key, Buf * right_b) {
 	int left_index;
 	internal_page * parent;
 	internal_page * left;
-	header_page * hp;
-	Buf * b, * hb;
+	Buf * b;
 
 	left = (internal_page *) left_b->page;
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
-	release_pincount(hb);
 
 	/* Case : new root. */
-	if (left_b->page_offset == hp->root_page) 
+	if (left_b->page_offset == descs[table_id].root_page) 
 		return insert_into_new_root(table_id, left_b, key, right_b);
 
 	/* Case : leaf or internal page.
@@ -357,7 +415,7 @@ int insert_into_parent(int table_id, Buf * left_b, int64_t key, Buf * right_b) {
 	 */
 
 	parent = (internal_page *)b->page;
-	if (parent->num_keys < INTERNAL_ORDER - 1)
+	if (parent->num_keys < internal_order - 1)
 		return insert_into_internal(b, left_index, key, right_b);
 
 	/* Harder case : split a page in order
@@ -374,14 +432,10 @@ int insert_into_parent(int table_id, Buf * left_b, int64_t key, Buf * right_b) {
 int insert_into_new_root(int table_id, Buf * left_b, int64_t key, Buf * right_b) {
 
 	//printf("insert_into_new_root : %ld \n", key);
-	Buf * root_b, * hb;
+	Buf * root_b;
 	internal_page * root, * left, * right;
-	header_page * hp;
-	
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
 
-	root_b = get_buf(table_id, hp->free_page);
+	root_b = get_buf(table_id, descs[table_id].free_page);
 	root = (internal_page *)root_b->page;
 
 	left = (internal_page *)left_b->page;
@@ -395,18 +449,17 @@ int insert_into_new_root(int table_id, Buf * left_b, int64_t key, Buf * right_b)
 	root->is_leaf = false;
 	left->parent_page = root_b->page_offset;
 	right->parent_page = root_b->page_offset;
-	hp->root_page = root_b->page_offset;
+	descs[table_id].root_page = root_b->page_offset;
+	descs[table_id].dirty = true;
 
 	// Write to disk
 	mark_dirty(root_b);
 	mark_dirty(left_b);
 	mark_dirty(right_b);
-	mark_dirty(hb);
 
 	release_pincount(root_b);
 	release_pincount(left_b);
 	release_pincount(right_b);
-	release_pincount(hb);
 
 	return 0;
 }
@@ -418,28 +471,63 @@ int insert_into_new_root(int table_id, Buf * left_b, int64_t key, Buf * right_b)
  * properties.
  */
 int insert(int table_id, int64_t key, char * value) {
+	int result;
 
-	Buf * b;
-	leaf_page * leaf;
-	
-	// If key is duplicate 
-	if (find(table_id, key) != NULL) {
-		//printf("error : INSERT DUPLICATE KEY <%ld> !!!\n", key);
-		return -1; 
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table_map[table_id] != NULL) {
+		printf("insert() error : table %d is read only\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
 	}
+	result = put_record(table_id, key, value, false);
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	return result;
+}
 
-	/* Case : the tree already exists.
-	 */
+/* Inserts key and value, or overwrites value
+ * if key already exists.
+ */
+int upsert(int table_id, int64_t key, char * value) {
+	int result;
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table_map[table_id] != NULL) {
+		printf("upsert() error : table %d is read only\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+	result = put_record(table_id, key, value, true);
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	return result;
+}
+
+/* insert and upsert without table latch.
+ * Tree is descended once, and key is checked
+ * in the leaf where it would be inserted.
+ * If key is duplicate, value is overwritten if overwrite is true.
+ * Otherwise, return -1.
+ */
+int put_record(int table_id, int64_t key, char * value, bool overwrite) {
+	Buf * b;
+	leaf_page * leaf;
+	int i;
 
 	b = find_leaf(table_id, key);
 	leaf = (leaf_page *) b->page;
 
+	// If key is duplicate
+	if ((i = find_in_leaf(leaf, key)) >= 0) {
+		if (overwrite)
+			return update_record(b, i, value);
+		release_pincount(b);
+		return -1;
+	}
+
 	/* Case : leaf has room for key.
 	 */
 
-	if (leaf->num_keys < LEAF_ORDER - 1) {
+	if (leaf->num_keys < leaf_order - 1)
 		return insert_into_leaf(b, key, value);
-	}
 
 	/* Case : leaf must be split.
 	 */
@@ -456,20 +544,22 @@ int insert(int table_id, int64_t key, char * value) {
  * this special case.
  */
 int get_neighbor_index(int table_id, Buf * b) {
-	int i;
+	int i, result;
 	internal_page * c, * parent;
 	Buf * pb;
 	c = (internal_page *)b->page;
 	pb = get_buf(table_id, c->parent_page);
 	parent = (internal_page *)pb->page;
-	release_pincount(pb);
-
-	if (parent->one_more_page == b->page_offset)
-		return -2;
 
-	for (i = 0; i <= parent->num_keys; i++)
-		if (parent->records[i].page_offset == b->page_offset)
-			return i - 1;
+	result = -2;
+	if (parent->one_more_page != b->page_offset) {
+		for (i = 0; i <= parent->num_keys; i++)
+			if (parent->records[i].page_offset == b->page_offset)
+				break;
+		result = i - 1;
+	}
+	release_pincount(pb);
+	return result;
 }
 
 Buf * remove_entry_from_page(Buf * b, int64_t key) {
@@ -483,18 +573,10 @@ Buf * remove_entry_from_page(Buf * b, int64_t key) {
 		// If page is leaf page.
 		leaf = (leaf_page *)b->page;
 		if (trx)
-			leaf->page_lsn = complete_log(b, UPDATE);
+			leaf->page_lsn = create_log(b, UPDATE);
 
 		// Remove the key and shift other keys accordingly.
-		i = 0;
-		while (leaf->records[i].key != key && i < leaf->num_keys) {
-			i++;
-		}
-		for (++i; i < leaf->num_keys; i++) {
-			leaf->records[i - 1].key = leaf->records[i].key;
-			memcpy(leaf->records[i - 1].value, leaf->records[i].value, VALUE_SIZE);
-		}
-		leaf->num_keys--;
+		remove_from_leaf_at(leaf, search_leaf(leaf, key));
 		if (trx)
 			complete_log(b, UPDATE);
 		mark_dirty(b);
@@ -502,9 +584,8 @@ Buf * remove_entry_from_page(Buf * b, int64_t key) {
 		// If page is internal page.
 		if (trx)
 			c->page_lsn = create_log(b, UPDATE);
-		i = 0;
-		while (c->records[i].key != key)
-			i++;
+		// Keys of internal page are unique.
+		i = search_internal(c, key) - 1;
 		for (++i; i < c->num_keys; i++) {
 			c->records[i - 1].key = c->records[i].key;
 			c->records[i - 1].page_offset = c->records[i].page_offset;
@@ -520,9 +601,8 @@ Buf * remove_entry_from_page(Buf * b, int64_t key) {
 
 int adjust_root(int table_id, Buf * b) {
 
-	Buf * nb, *hb;
+	Buf * nb;
 	internal_page * nroot;
-	header_page * hp;
 	internal_page * root = (internal_page *)b->page;
 	
 	/* Case : nonempty root.
@@ -542,25 +622,21 @@ int adjust_root(int table_id, Buf * b) {
 	// the first (only) child
 	// as the new root.
 	
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
-	
 	if (!root->is_leaf) {
-		hp->root_page = root->one_more_page;
+		descs[table_id].root_page = root->one_more_page;
+		descs[table_id].dirty = true;
 		nb = get_buf(table_id, root->one_more_page);
 		nroot = (internal_page *)nb->page;
 		nroot->parent_page = 0;
-		b->page_offset = -1;
+		unmap_buf(b);
 
-		mark_dirty(hb);
 		mark_dirty(nb);
 		mark_dirty(b);
 
-		release_pincount(hb);
-		release_pincount(b);
 		release_pincount(nb);
 
 	}
+	release_pincount(b);
 	return 0;
 }
 
@@ -573,18 +649,14 @@ int adjust_root(int table_id, Buf * b) {
 int coalesce_pages (int table_id, Buf * b, Buf * nb, int neighbor_index, int64_t k_prime) {
 
 	int i, j, neighbor_insertion_index, n_end;
-	Buf * temp, * child, * parent_b, * hb;
+	Buf * temp, * child, * parent_b;
 	internal_page * ci, *ni, * cp;
 	leaf_page * cl, *nl;
-	header_page * hp;
 
 	/* Swap neighbor with page if page is on the
 	 * extreme left and neighbor is to its right.
 	 */
 
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
-
 	if (neighbor_index == -2) {
 		temp = b;
 		b = nb;
@@ -638,8 +710,8 @@ int coalesce_pages (int table_id, Buf * b, Buf * nb, int neighbor_index, int64_t
 		}
 
 		ci->parent_page = 0;
-		hp->num_pages--;
-		b->page_offset = PAGE_NONE;
+		descs[table_id].num_pages--;
+		unmap_buf(b);
 
 	}
 
@@ -650,22 +722,19 @@ int coalesce_pages (int table_id, Buf * b, Buf * nb, int neighbor_index, int64_t
 	else {
 		cl = (leaf_page *)b->page;
 		nl = (leaf_page *)nb->page;
-		for (i = neighbor_insertion_index, j = 0; j < cl->num_keys; i++, j++) {
-			nl->records[i].key = cl->records[j].key;
-			memcpy(nl->records[i].value, cl->records[j].value, VALUE_SIZE);
-			nl->num_keys++;
-		}
+		for (j = 0; j < cl->num_keys; j++)
+			insert_into_leaf_at(nl, nl->num_keys, cl->keys[j], LEAF_VALUE(cl, j));
 		nl->right_sibling = cl->right_sibling;
+		set_left_sibling(table_id, cl->right_sibling, nb->page_offset);
 
 		cl->parent_page = 0;
-		hp->num_pages--;
-		b->page_offset = PAGE_NONE;
+		descs[table_id].num_pages--;
+		unmap_buf(b);
 	}
-	mark_dirty(hb);
+	descs[table_id].dirty = true;
 	mark_dirty(b);
 	mark_dirty(nb);
 	
-	release_pincount(hb);
 	release_pincount(b);
 	release_pincount(nb);
 
@@ -677,14 +746,18 @@ int coalesce_pages (int table_id, Buf * b, Buf * nb, int neighbor_index, int64_t
  * but its neighbor is too big to append the
  * small page's entries without exceeding the
  * maximum.
+ * Leaves are balanced evenly, so leaf which lost many
+ * keys by delete_batch reaches minimum at once.
  */
 
 int redistribute_pages(int table_id, Buf * b, Buf * nb, int neighbor_index, 
 		int k_prime_index, int k_prime) {
-	int i;
+	int i, num;
 	internal_page * ci, * ni, * parent;
 	leaf_page * cl, * nl;
-	Buf * tmp, * pb;
+	Buf * pb, * child;
+	// Only internal page moves child.
+	int64_t moved_child = 0;
 
 	/* Case : b has a neighbor to the left.
 	 * Pull the neighbor's last key-pointer pair over
@@ -701,28 +774,25 @@ int redistribute_pages(int table_id, Buf * b, Buf * nb, int neighbor_index,
 			cl = (leaf_page *)b->page;
 			nl = (leaf_page *)nb->page;
 
-			for (i = cl->num_keys; i > 0; i--) {
-				cl->records[i].key = cl->records[i - 1].key;
-				memcpy(cl->records[i].value, cl->records[i - 1].value, VALUE_SIZE);
+			num = (nl->num_keys - cl->num_keys) / 2;
+			for (i = 0; i < num || i == 0; i++) {
+				insert_into_leaf_at(cl, 0, nl->keys[nl->num_keys - 1],
+						LEAF_VALUE(nl, nl->num_keys - 1));
+				remove_from_leaf_at(nl, nl->num_keys - 1);
 			}
-			cl->records[0].key = nl->records[nl->num_keys - 1].key;
-			memcpy(cl->records[0].value, nl->records[nl->num_keys - 1].value, VALUE_SIZE);
-			parent->records[k_prime_index].key = cl->records[0].key;
-
-			nl->records[nl->num_keys - 1].key = -1;
-			cl->num_keys--;
-			nl->num_keys++;
-					
+			parent->records[k_prime_index].key = cl->keys[0];
+
 		} else {
 			// If page is internal page
 			ni = (internal_page *)nb->page;
-			for (i = cl->num_keys; i > 0; i--) {
+			for (i = ci->num_keys; i > 0; i--) {
 				ci->records[i].key = ci->records[i - 1].key;
 				ci->records[i].page_offset = ci->records[i - 1].page_offset;
 			}
 			ci->records[0].key = k_prime;
 			ci->records[0].page_offset = ci->one_more_page;
 			ci->one_more_page = ni->records[ni->num_keys - 1].page_offset;
+			moved_child = ci->one_more_page;
 			parent->records[k_prime_index].key = ni->records[ni->num_keys - 1].key;
 
 			ci->num_keys++;
@@ -742,21 +812,18 @@ int redistribute_pages(int table_id, Buf * b, Buf * nb, int neighbor_index,
 		cl = (leaf_page *)b->page;
 		nl = (leaf_page *)nb->page;
 
-		cl->records[cl->num_keys].key = nl->records[0].key;
-		memcpy(cl->records[cl->num_keys].value, nl->records[0].value, VALUE_SIZE);
-		parent->records[k_prime_index].key = nl->records[1].key;
-
-		for (i = 0; i < nl->num_keys - 1; i++) {
-			nl->records[i].key = nl->records[i + 1].key;
-			memcpy(nl->records[i].value, nl->records[i + 1].value, VALUE_SIZE);
+		num = (nl->num_keys - cl->num_keys) / 2;
+		for (i = 0; i < num || i == 0; i++) {
+			insert_into_leaf_at(cl, cl->num_keys, nl->keys[0], LEAF_VALUE(nl, 0));
+			remove_from_leaf_at(nl, 0);
 		}
-		nl->num_keys--;
-		cl->num_keys++;
+		parent->records[k_prime_index].key = nl->keys[0];
 
 		} else {
 			ni = (internal_page *)nb->page;
 			ci->records[ci->num_keys].key = k_prime;
 			ci->records[ci->num_keys].page_offset = ni->one_more_page;
+			moved_child = ni->one_more_page;
 			parent->records[k_prime_index].key = ni->records[0].key;
 			ni->one_more_page = ni->records[0].page_offset;
 
@@ -769,6 +836,15 @@ int redistribute_pages(int table_id, Buf * b, Buf * nb, int neighbor_index,
 
 		}
 	}
+
+	// Child moved from neighbor points up to b.
+	if (!ci->is_leaf) {
+		child = get_buf(table_id, moved_child);
+		((internal_page *)child->page)->parent_page = b->page_offset;
+		mark_dirty(child);
+		release_pincount(child);
+	}
+
 	mark_dirty(b);
 	mark_dirty(pb);
 	mark_dirty(nb);
@@ -787,25 +863,27 @@ int redistribute_pages(int table_id, Buf * b, Buf * nb, int neighbor_index,
  * changes to preserve the B+ tree properties.
  */
 int delete_entry(int table_id, Buf * b, int64_t key) {
+	// Remove key and value from page.
+	
+	b = remove_entry_from_page(b, key);
+	return balance_page(table_id, b);
+}
+
+/* Keeps page at or above minimum size
+ * after its entries are removed.
+ * b is released.
+ */
+int balance_page(int table_id, Buf * b) {
 	int min_keys;
-	Buf * nb, * pb, * hb;
+	Buf * nb, * pb;
 	int neighbor_index;
 	int64_t k_prime, k_prime_index, nb_offset;
 	int capacity;
 	internal_page * ipage, * parent, * neighbor;
-	header_page * hp;
-
-	// Remove key and value from page.
-	
-	b = remove_entry_from_page(b, key);
-
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
-	release_pincount(hb);
 
 	/* Case : deletion from the root.
 	 */
-	if (b->page_offset == hp->root_page)
+	if (b->page_offset == descs[table_id].root_page)
 		return adjust_root(table_id, b);
 
 	/* Case : deletion from a page below the root.
@@ -817,7 +895,7 @@ int delete_entry(int table_id, Buf * b, int64_t key) {
 
 	ipage = (internal_page *) b->page;
 
-	min_keys = ipage->is_leaf ? cut(LEAF_ORDER - 1) : cut(INTERNAL_ORDER - 1) - 1;
+	min_keys = ipage->is_leaf ? cut(leaf_order - 1) : cut(internal_order - 1) - 1;
 
 	/* Case : page stays at or above minimum.
 	 * (The simple case.)
@@ -842,7 +920,6 @@ int delete_entry(int table_id, Buf * b, int64_t key) {
 	
 	pb = get_buf(table_id, ipage->parent_page);
 	parent = (internal_page *)pb->page;
-	release_pincount(pb);
 
 	neighbor_index = get_neighbor_index(table_id, b);
 	k_prime_index = neighbor_index == -2 ? 0 : neighbor_index + 1;
@@ -854,10 +931,12 @@ int delete_entry(int table_id, Buf * b, int64_t key) {
 	} else {
 		nb_offset = parent->records[neighbor_index].page_offset;
 	}
+	release_pincount(pb);
 
 	nb = get_buf(table_id, nb_offset);
 	neighbor = (internal_page *) nb->page;
-	capacity = ipage->is_leaf ? LEAF_ORDER - 1 : INTERNAL_ORDER - 1;
+	// Coalescing internal pages also pulls down k_prime.
+	capacity = ipage->is_leaf ? leaf_order - 1 : internal_order - 2;
 
 	/* Coalescence. */
 
@@ -875,13 +954,25 @@ int delete_entry(int table_id, Buf * b, int64_t key) {
 int delete(int table_id, int64_t key) {
 
 	Buf * b;
-	
-	if (find(table_id, key) == NULL) {
-	//	printf("key : %ld doesn't exist.\n", key);
-		return 0;
+	int result;
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table_map[table_id] != NULL) {
+		printf("delete() error : table %d is read only\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
 	}
 
+	// Key is checked in the leaf, so tree is descended once.
 	b = find_leaf(table_id, key);
-	return delete_entry(table_id, b, key);
+	if (find_in_leaf((leaf_page *)b->page, key) < 0) {
+	//	printf("key : %ld doesn't exist.\n", key);
+		release_pincount(b);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return 0;
+	}
+	result = delete_entry(table_id, b, key);
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	return result;
 }
 
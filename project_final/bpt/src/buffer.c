@@ -8,44 +8,23 @@
 
 #include "bpt.h"
 
-Buf * read_headerpage(int table_id) {
-	int i = 0;
+Buf * read_headerpage(buf_partition * p, int table_id) {
+	int i;
 	Buf * hb;
 	// Find buffer frame to use
-	while (1) {
-		if (i == num_buf) {
-			make_victim();
-			i = 0;
-		}
-		if (buf[i].page_offset == PAGE_NONE)
-			break;
-		i++;
-	}
+	i = get_free_buffer_index(p, table_id);
 	// Register header page to buffer frame.
 	hb = &buf[i];
-	read_page(table_id, hb->page, PAGE_SIZE, HEADERPAGE_OFFSET);
+	p->stats.misses++;
+	read_page(table_id, hb->page, page_size, HEADERPAGE_OFFSET);
 	hb->table_id = table_id;
 	hb->page_offset = HEADERPAGE_OFFSET;
-	hb->pin_count = 1;
+	hb->pin_count = 0;
 	hb->in_LRU = false;
 	hb->is_dirty = 1;
-
-	return register_header_LRU(hb); 
-}
-
-Buf * register_header_LRU(Buf * hb) {
-
-	if (LRU_list->num_lru >= num_buf && hb->in_LRU == false) {
-		make_victim();
-	}
-
-	// Update LRU
-	hb->lru->next = LRU_list->head->next;
-	LRU_list->head->next->prev = hb->lru;
-	hb->lru->prev = LRU_list->head;
-	LRU_list->head->next = hb->lru;
-	hb->in_LRU = true;
-	LRU_list->num_lru++;
+	hash_insert(&p->page_table, table_id, HEADERPAGE_OFFSET, i);
+	p->table_frames[table_id]++;
+	touch_buf(hb, ACCESS_RANDOM);
 
 	return hb;
 }
@@ -54,23 +33,82 @@ Buf * register_header_LRU(Buf * hb) {
 Buf * init_headerpage (int table_id) {
 	int i;
 	Buf * hb;
+	buf_partition * p;
+
+	p = get_partition(table_id, HEADERPAGE_OFFSET);
+	pthread_mutex_lock(&p->latch);
 	// Find buffer frame to use
-	for (i = 0; i < num_buf; i++)
-		if (buf[i].page_offset == PAGE_NONE)
-			break;
+	i = get_free_buffer_index(p, table_id);
 	// Register header page to buffer frame.
 	hb = &buf[i];
 	hb->table_id = table_id;
 	hb->page_offset = HEADERPAGE_OFFSET;
-	hb->pin_count = 1;
+	hb->pin_count = 0;
 	hb->is_dirty = 1;
+	hash_insert(&p->page_table, table_id, HEADERPAGE_OFFSET, i);
+	p->table_frames[table_id]++;
+	touch_buf(hb, ACCESS_RANDOM);
+	pthread_mutex_unlock(&p->latch);
+
+	return hb;
+}
+
+// Fill descriptor of table from its header page.
+void load_table_desc(int table_id, header_page * hp) {
+	descs[table_id].root_page = hp->root_page;
+	descs[table_id].free_page = hp->free_page;
+	descs[table_id].num_pages = hp->num_pages;
+	descs[table_id].dirty = false;
+}
 
-	return register_header_LRU(hb);
+/* Store changed descriptor of table to its header page.
+ * Caller holds write latch of table, or no other thread runs.
+ */
+void store_table_desc(int table_id) {
+	Buf * hb;
+	header_page * hp;
+
+	if (!descs[table_id].dirty)
+		return;
+	hb = get_buf(table_id, HEADERPAGE_OFFSET);
+	hp = (header_page *)hb->page;
+	hp->root_page = descs[table_id].root_page;
+	hp->free_page = descs[table_id].free_page;
+	hp->num_pages = descs[table_id].num_pages;
+	mark_dirty(hb);
+	release_pincount(hb);
+	descs[table_id].dirty = false;
 }
 
-// Release pin_count of page.
+static void write_victim(buf_partition * p, Buf * vb);
+static void evict_buf(buf_partition * p, Buf * vb);
+
+/* Release pin_count of page.
+ * Latch is not needed to unpin, so pin_count is changed atomically.
+ * If frame is cut off by resize, it is removed when page is unpinned.
+ * If page becomes unpinned while other thread waits for victim,
+ * wake it up.
+ */
 void release_pincount(Buf * b) {
-	b->pin_count--;
+	buf_partition * p = &partitions[b->part];
+
+	if (__atomic_sub_fetch(&b->pin_count, 1, __ATOMIC_SEQ_CST) != 0)
+		return;
+	// Frame cut off by resize is removed by the last unpin.
+	if (__atomic_load_n(&b->retire, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&p->latch);
+		if (b->retire && !b->io_pending && b->in_LRU &&
+				__atomic_load_n(&b->pin_count, __ATOMIC_ACQUIRE) == 0) {
+			policy->remove(p, b);
+			evict_buf(p, b);
+		}
+		pthread_mutex_unlock(&p->latch);
+	}
+	if (__atomic_load_n(&p->num_waiters, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&p->latch);
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->latch);
+	}
 }
 
 // Mark dirty bit of page.
@@ -80,24 +118,198 @@ void mark_dirty(Buf * b) {
 
 // Initialize all buffer frame
 void init_buf(int i) {
-	buf[i].page = (Page *) malloc(sizeof(Page));
+	buf[i].page = (Page *)(frame_arena + (size_t)i * page_size);
 	buf[i].table_id = 0;
 	buf[i].page_offset = PAGE_NONE;
 	buf[i].is_dirty = false;
 	buf[i].pin_count = 0;
-	buf[i].lru = (LRU *) malloc(sizeof(LRU));
+	buf[i].in_LRU = false;
+	buf[i].lru = &lru_nodes[i];
+	buf[i].ref = false;
+	buf[i].hot = false;
+	buf[i].test = false;
+	buf[i].part = i % num_partitions;
+	buf[i].io_pending = false;
+	buf[i].retire = false;
+}
+
+/* Allocate frames of num pages as one page-aligned arena,
+ * and descriptors of frames as parallel arrays.
+ * Address space of max_buf frames is reserved, so frames never move
+ * when pool is resized. Memory is used only when frame is touched.
+ * If huge_pages option is set, arena is rounded up to huge page size
+ * and advised to be backed by transparent huge pages.
+ * If success, return 0. Otherwise, return -1.
+ */
+int alloc_frame_arena(int num) {
+	max_buf = config.max_frames > num ? config.max_frames : num * POOL_RESERVE_FACTOR;
+	arena_size = (size_t)max_buf * page_size;
+	if (config.huge_pages)
+		arena_size = (arena_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	frame_arena = (char *) mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (frame_arena == MAP_FAILED) {
+		printf("fail to allocate buffer pool\n");
+		frame_arena = NULL;
+		return -1;
+	}
+#ifdef MADV_HUGEPAGE
+	// It is only advice. If kernel doesn't support it, 4 KB pages are used.
+	if (config.huge_pages)
+		madvise(frame_arena, arena_size, MADV_HUGEPAGE);
+#endif
+
+	buf = (Buf *) malloc(sizeof(Buf) * max_buf);
+	lru_nodes = (LRU *) malloc(sizeof(LRU) * max_buf);
+	return 0;
+}
+
+void free_frame_arena(void) {
+	munmap(frame_arena, arena_size);
+	free(buf);
+	free(lru_nodes);
+	frame_arena = NULL;
+	buf = NULL;
+	lru_nodes = NULL;
+}
+
+// Default options of init_db.
+void default_db_config(db_config * config) {
+	config->policy = POLICY_LRU;
+	config->page_cleaner = false;
+	config->cleaner_interval = CLEANER_INTERVAL;
+	config->num_partitions = 1;
+	config->huge_pages = false;
+	config->max_frames = 0;
+	config->warmup = true;
+	config->checkpoint_interval = 0;
+	config->readahead_pages = READAHEAD_PAGES;
+	config->io_backend = IO_BLOCKING;
+	config->durability = DURABILITY_STRICT;
+	config->page_size = DEFAULT_PAGE_SIZE;
+}
+
+// Table without quota has no reserved frame and no limit.
+void default_table_quota(table_quota * quota) {
+	quota->min_frames = 0;
+	quota->max_percent = 100;
+	quota->priority = PRIORITY_NORMAL;
+}
+
+static bool is_default_quota(table_quota * quota) {
+	return quota->min_frames == 0 && quota->max_percent == 100 &&
+		quota->priority == PRIORITY_NORMAL;
 }
 
-// Initialize LRU_list.
-void init_LRU(void) {
-	LRU_list = (LRU_LIST *)malloc(sizeof(LRU_LIST));
-	LRU * dummy_head = (LRU *)malloc(sizeof(LRU));
-	LRU * dummy_tail = (LRU *)malloc(sizeof(LRU));
-	dummy_head->next = dummy_tail;
-	dummy_tail->prev = dummy_head;
-	LRU_list->head = dummy_head;
-	LRU_list->tail = dummy_tail;
-	LRU_list->num_lru = 0;
+/* Set buffer pool quota of opened table.
+ * Latches of every partition are held, so make_victim
+ * sees whole quota at once.
+ * If success, return 0. Otherwise, return -1.
+ */
+int set_table_quota(int table_id, table_quota * quota) {
+	int i;
+
+	if (table_id < 1 || table_id > 10 || quota->min_frames < 0 ||
+			quota->max_percent < 1 || quota->max_percent > 100 ||
+			quota->priority < PRIORITY_LOW || quota->priority > PRIORITY_HIGH) {
+		printf("set_table_quota() error : invalid quota of table %d\n", table_id);
+		return -1;
+	}
+	for (i = 0; i < num_partitions; i++)
+		pthread_mutex_lock(&partitions[i].latch);
+	if (!is_default_quota(&quotas[table_id]))
+		num_quotas--;
+	quotas[table_id] = *quota;
+	if (!is_default_quota(&quotas[table_id]))
+		num_quotas++;
+	for (i = num_partitions - 1; i >= 0; i--)
+		pthread_mutex_unlock(&partitions[i].latch);
+	return 0;
+}
+
+/* Set page size and sizes derived from it.
+ * Page size is power of 2 from MIN_PAGE_SIZE to MAX_PAGE_SIZE.
+ * If success, return 0. Otherwise, return -1.
+ */
+int set_page_size(int size) {
+	if (size < MIN_PAGE_SIZE || size > MAX_PAGE_SIZE || (size & (size - 1)) != 0)
+		return -1;
+	page_size = size;
+	leaf_order = (page_size - PAGE_HEADER) / sizeof(leaf_record) + 1;
+	leaf_slot_offset = offsetof(leaf_page, slots);
+	// Slots of large page don't fit in header, so they take room of records.
+	if (leaf_order - 1 > LEAF_HEADER_SLOTS) {
+		leaf_order = (page_size - PAGE_HEADER) / (sizeof(leaf_record) + 1) + 1;
+		leaf_slot_offset = PAGE_HEADER + (leaf_order - 1) * sizeof(int64_t);
+	}
+	leaf_value_offset = PAGE_HEADER + (leaf_order - 1) * sizeof(int64_t);
+	if (leaf_slot_offset >= PAGE_HEADER)
+		leaf_value_offset += leaf_order - 1;
+	internal_order = (page_size - PAGE_HEADER) / sizeof(internal_record) + 1;
+	join_result_size = page_size / sizeof(result_value);
+	log_size = LOG_HEADER_SIZE + 2 * page_size;
+	return 0;
+}
+
+/* Initialize partition which owns every frame i
+ * where i % num_partitions is index of partition.
+ */
+static void init_partition(buf_partition * p, int index) {
+	int i, capacity;
+	pthread_mutexattr_t attr;
+
+	p->num_frames = 0;
+	for (i = index; i < num_buf; i += num_partitions)
+		p->num_frames++;
+	// Room for frames added by resize_buffer_pool.
+	capacity = (max_buf + num_partitions - 1) / num_partitions;
+	p->frames = (int *) malloc(sizeof(int) * capacity);
+	p->free_frames = (int *) malloc(sizeof(int) * capacity);
+	p->num_free = 0;
+
+	// Push in reverse order, so the lowest frame is used first.
+	for (i = 0; i < p->num_frames; i++)
+		p->frames[i] = index + i * num_partitions;
+	for (i = p->num_frames - 1; i >= 0; i--)
+		push_free_frame(p, p->frames[i]);
+
+	init_page_hash(&p->page_table, p->num_frames);
+	policy->init(p);
+
+	// make_buf may read header page of the same partition while it holds latch.
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&p->latch, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_cond_init(&p->cond, NULL);
+	p->num_waiters = 0;
+	p->cleaner_writing = false;
+	memset(&p->stats, 0, sizeof(buf_stats));
+	memset(p->table_frames, 0, sizeof(p->table_frames));
+}
+
+static void free_partition(buf_partition * p) {
+	policy->destroy(p);
+	free_page_hash(&p->page_table);
+	free(p->frames);
+	free(p->free_frames);
+	pthread_mutex_destroy(&p->latch);
+	pthread_cond_destroy(&p->cond);
+}
+
+/* Partition of page.
+ * It uses other bits of hash than page table,
+ * so pages of partition are spread over its page table.
+ */
+buf_partition * get_partition(int table_id, int64_t offset) {
+	uint64_t key;
+
+	if (num_partitions == 1)
+		return &partitions[0];
+	key = ((uint64_t)(offset / page_size) << 8) ^ (uint64_t)table_id;
+	key *= 0xC2B2AE3D27D4EB4FULL;
+	return &partitions[(key >> 40) % num_partitions];
 }
 
 
@@ -106,205 +318,715 @@ void init_LRU(void) {
  * If success, return 0. Otherwise, return non-zero value.
  */
 int init_db(int num) {
+	return init_db_with_config(num, NULL);
+}
+
+/* Allocate the buffer pool with given options.
+ * If config is NULL, default options are used.
+ */
+int init_db_with_config(int num, db_config * c) {
 	int i;
-	num_buf = num;
-	buf = (Buf *) malloc(sizeof(Buf) * num_buf);
+	pthread_mutexattr_t attr;
+
+	if (c != NULL)
+		config = *c;
+	else
+		default_db_config(&config);
+	if (set_page_size(config.page_size) != 0) {
+		printf("init_db() error : page size %d is not supported\n", config.page_size);
+		return -1;
+	}
 
-	for (i = 0; i < num_buf; i++)
+	num_buf = num;
+	// Each partition has at least PARTITION_MIN_FRAMES frames.
+	num_partitions = config.num_partitions;
+	if (num_partitions > num_buf / PARTITION_MIN_FRAMES)
+		num_partitions = num_buf / PARTITION_MIN_FRAMES;
+	if (num_partitions < 1)
+		num_partitions = 1;
+
+	if (alloc_frame_arena(num_buf) != 0)
+		return -1;
+	// Frames beyond num_buf are initialized too, so resize can check them.
+	for (i = 0; i < max_buf; i++)
 		init_buf(i);
 
-	init_LRU();
-	init_log();
+	policy = get_replacer(config.policy);
+	partitions = (buf_partition *) malloc(sizeof(buf_partition) * num_partitions);
+	for (i = 0; i < num_partitions; i++)
+		init_partition(&partitions[i], i);
+
+	pthread_mutex_init(&cleaner_latch, NULL);
+	pthread_cond_init(&cleaner_cond, NULL);
+	pthread_mutex_init(&warm_latch, NULL);
+	pthread_cond_init(&warm_cond, NULL);
+	memset(warm_pending, 0, sizeof(warm_pending));
+	warm_list = NULL;
+	num_warm = 0;
+	if (config.warmup)
+		load_warm_list();
+	for (i = 0; i < 11; i++)
+		pthread_rwlock_init(&table_latch[i], NULL);
+	pthread_mutex_init(&ra_latch, NULL);
+	pthread_cond_init(&ra_cond, NULL);
+	memset(ra_state, 0, sizeof(ra_state));
+	for (i = 0; i < 11; i++)
+		default_table_quota(&quotas[i]);
+	num_quotas = 0;
+	ra_head = ra_num = 0;
+	init_io();
+	init_search();
+
+	// Log records are created and completed by the same thread.
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&log_latch, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	if (init_log() != 0) {
+		printf("init_db() error : fail to open or recover log\n");
+		return -1;
+	}
+
+	// Tables opened by recovery are already requested.
+	start_warmup();
+	start_readahead();
+	if (config.page_cleaner || (config.checkpoint_interval > 0 &&
+			(config.warmup || config.durability == DURABILITY_WAL)))
+		start_page_cleaner();
 
 	return 0;
 }
 
 
-/* Make victim page and remove.
+/* Move page of frame b to free frame of the same partition.
+ * Its replacement state is not kept, it is admitted again.
  */
-void make_victim() {
-	int i;
-	Buf * vb;
-	LRU * d_lru;
-	internal_page * page;
+static void migrate_frame(buf_partition * p, Buf * b, int to) {
+	Buf * nb = &buf[to];
+
+	memcpy(nb->page, b->page, page_size);
+	nb->table_id = b->table_id;
+	nb->page_offset = b->page_offset;
+	nb->is_dirty = b->is_dirty;
+	nb->pin_count = 0;
+	hash_insert(&p->page_table, b->table_id, b->page_offset, to);
+	policy->admit(p, nb, ACCESS_RANDOM);
+	nb->in_LRU = true;
+
+	b->is_dirty = false;
+	b->in_LRU = false;
+	b->page_offset = PAGE_NONE;
+}
 
-	while (1) {
-		d_lru = LRU_list->tail->prev;
-		// Remove in LRU_list.
-		d_lru->prev->next = LRU_list->tail;
-		LRU_list->tail->prev = d_lru->prev;
-
-		vb = d_lru->buf;
-
-		if (vb->pin_count != 0) {
-			// If victim page is using, current page moves to head of LRU_li     st
-			d_lru->next = LRU_list->head->next;
-			LRU_list->head->next->prev = d_lru;
-			d_lru->prev = LRU_list->head;
-			LRU_list->head->next = d_lru;
+/* Remove frame b, which doesn't hold page, from partition.
+ * Caller holds latch of partition.
+ */
+static void drop_frame(buf_partition * p, Buf * b) {
+	int i, n;
+
+	n = 0;
+	for (i = 0; i < p->num_frames; i++)
+		if (p->frames[i] != b - buf)
+			p->frames[n++] = p->frames[i];
+	p->num_frames = n;
+	b->retire = false;
+	policy->resize(p);
+	// Give memory of frame back.
+	madvise(b->page, page_size, MADV_DONTNEED);
+}
+
+/* Remove frames from num of partition.
+ * Resident pages are moved to free frames which are kept.
+ * If there is no free frame, page is written and dropped.
+ * Pinned frame, or frame being read, is marked to retire,
+ * and removed when it is unpinned.
+ */
+static void shrink_partition(buf_partition * p, int num) {
+	int i, n;
+	Buf * b;
+
+	// Free frames which are removed.
+	n = 0;
+	for (i = 0; i < p->num_free; i++)
+		if (p->free_frames[i] < num)
+			p->free_frames[n++] = p->free_frames[i];
+	p->num_free = n;
+
+	n = 0;
+	for (i = 0; i < p->num_frames; i++) {
+		b = &buf[p->frames[i]];
+		if (p->frames[i] < num) {
+			p->frames[n++] = p->frames[i];
+			continue;
+		}
+		// Mark is set before pin is checked, so last unpin sees either of them.
+		__atomic_store_n(&b->retire, true, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&b->pin_count, __ATOMIC_ACQUIRE) != 0 || b->io_pending) {
+			p->frames[n++] = p->frames[i];
 			continue;
 		}
-		break;
+		b->retire = false;
+		if (b->in_LRU) {
+			policy->remove(p, b);
+			if (b->page_offset >= 0 && p->num_free > 0)
+				migrate_frame(p, b, p->free_frames[--p->num_free]);
+			else
+				write_victim(p, b);
+		}
+		madvise(b->page, page_size, MADV_DONTNEED);
 	}
+	p->num_frames = n;
+}
+
+/* Grow or shrink buffer pool to num frames while tables stay open.
+ * Frames don't move, so pinned pages stay where they are.
+ * When pool shrinks, pages of removed frames are moved to free frames
+ * or written back and dropped. Frame of pinned page is kept
+ * until the page is unpinned.
+ * If success, return 0. Otherwise, return -1.
+ */
+int resize_buffer_pool(int num) {
+	int i, old_num;
+	buf_partition * p;
+	bool cleaner;
+
+	if (num < num_partitions || num > max_buf) {
+		printf("resize_buffer_pool() error : size must be %d ~ %d\n", num_partitions, max_buf);
+		return -1;
+	}
+
+	// Stop every user of buffer pool.
+	cleaner = cleaner_running;
+	stop_page_cleaner();
+	for (i = 0; i < 11; i++)
+		pthread_rwlock_wrlock(&table_latch[i]);
+	for (i = 0; i < num_partitions; i++)
+		pthread_mutex_lock(&partitions[i].latch);
+
+	old_num = num_buf;
+	if (num > old_num) {
+		num_buf = num;
+		for (i = old_num; i < num; i++) {
+			// Frame which waits to retire is still in partition.
+			if (buf[i].retire) {
+				buf[i].retire = false;
+				continue;
+			}
+			init_buf(i);
+			p = &partitions[buf[i].part];
+			p->frames[p->num_frames++] = i;
+		}
+		// Push in reverse order, so the lowest frame is used first.
+		for (i = num - 1; i >= old_num; i--)
+			if (buf[i].page_offset == PAGE_NONE && !buf[i].in_LRU)
+				push_free_frame(&partitions[buf[i].part], i);
+	} else if (num < old_num) {
+		for (i = 0; i < num_partitions; i++)
+			shrink_partition(&partitions[i], num);
+		num_buf = num;
+	}
+
+	if (num != old_num) {
+		for (i = 0; i < num_partitions; i++) {
+			p = &partitions[i];
+			rehash_page_hash(&p->page_table, p->num_frames);
+			policy->resize(p);
+		}
+	}
+
+	for (i = num_partitions - 1; i >= 0; i--)
+		pthread_mutex_unlock(&partitions[i].latch);
+	for (i = 10; i >= 0; i--)
+		pthread_rwlock_unlock(&table_latch[i]);
+	if (cleaner)
+		start_page_cleaner();
+
+	return 0;
+}
+
+
+// Frames of partition reserved for table.
+static int reserved_frames(int table_id) {
+	return (quotas[table_id].min_frames + num_partitions - 1) / num_partitions;
+}
+
+// Table holds its max share of partition.
+static bool over_share(buf_partition * p, int table_id) {
+	int max = p->num_frames * quotas[table_id].max_percent / 100;
+
+	return p->table_frames[table_id] >= (max > 0 ? max : 1);
+}
+
+/* Rank of page of table t as victim for page of table_id.
+ * Lower rank is evicted first. Page which must not be evicted
+ * is -1. It is page of other table under its reserved frames,
+ * or page of other table when table_id holds its max share.
+ */
+static int victim_rank(buf_partition * p, int t, int table_id, bool own) {
+	if (own && t != table_id)
+		return -1;
+	// Output page of join has no quota.
+	if (t < 1 || t > 10)
+		return 1 + PRIORITY_NORMAL;
+	if (t != table_id && p->table_frames[t] <= reserved_frames(t))
+		return -1;
+	if (over_share(p, t))
+		return 0;
+	return 1 + quotas[t].priority;
+}
+
+/* Choose unpinned page to evict for page of table_id,
+ * and detach it from replacement policy.
+ * Without table quota, replacement policy chooses victim.
+ * Otherwise the coldest pages are ranked, so page of table over
+ * its share goes first, then page of lower priority class.
+ * If no cold page can be evicted, victims of replacement policy
+ * which can't be evicted are pinned and put aside, so policy
+ * goes on to other pages. They are put back as they were
+ * when victim is found.
+ * Caller holds latch of partition.
+ */
+static Buf * choose_victim(buf_partition * p, int table_id) {
+	int i, n, rank, best, best_rank;
+	bool own;
+	Buf * cand[VICTIM_DEPTH], * vb, ** rejected;
+
+	if (num_quotas == 0)
+		return policy->victim(p);
+
+	// Table which holds its max share evicts its own page.
+	own = table_id >= 1 && table_id <= 10 && over_share(p, table_id);
+	n = policy->cold_pages(p, cand, VICTIM_DEPTH);
+	best = -1;
+	best_rank = 0;
+	for (i = 0; i < n; i++) {
+		rank = victim_rank(p, cand[i]->table_id, table_id, own);
+		if (rank >= 0 && (best < 0 || rank < best_rank)) {
+			best = i;
+			best_rank = rank;
+		}
+	}
+	if (best >= 0) {
+		policy->remove(p, cand[best]);
+		return cand[best];
+	}
+
+	rejected = (Buf **)malloc(sizeof(Buf *) * p->num_frames);
+	n = 0;
+	for (i = 0; i < p->num_frames; i++) {
+		if ((vb = policy->victim(p)) == NULL ||
+				victim_rank(p, vb->table_id, table_id, own) >= 0)
+			break;
+		__atomic_add_fetch(&vb->pin_count, 1, __ATOMIC_SEQ_CST);
+		rejected[n++] = vb;
+		vb = NULL;
+	}
+	// Reverse order keeps order of LRU.
+	while (n > 0) {
+		policy->reinsert(p, rejected[--n]);
+		__atomic_sub_fetch(&rejected[n]->pin_count, 1, __ATOMIC_SEQ_CST);
+	}
+	free(rejected);
+	if (vb != NULL)
+		return vb;
+	// Quota can't be kept.
+	return policy->victim(p);
+}
+
+/* Make victim page for page of table_id and remove.
+ * Caller holds latch of partition.
+ */
+void make_victim(buf_partition * p, int table_id) {
+	Buf * vb;
+	struct timespec ts;
+	bool warned = false;
+
+	// Replacement policy chooses unpinned page.
+	// Waiter is counted first, so unpinning thread sees it.
+	__atomic_add_fetch(&p->num_waiters, 1, __ATOMIC_SEQ_CST);
+	while ((vb = choose_victim(p, table_id)) == NULL) {
+		// Wait until other thread or page cleaner unpins page.
+		// Other threads hold pins briefly, so it is not given up.
+		p->stats.pin_waits++;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += PIN_WAIT_TIMEOUT;
+		if (pthread_cond_timedwait(&p->cond, &p->latch, &ts) == 0 || warned)
+			continue;
+		// Buffer pool may be too small for the number of threads.
+		printf("make_victim() warning : every page is pinned, still waiting\n");
+		warned = true;
+	}
+	__atomic_sub_fetch(&p->num_waiters, 1, __ATOMIC_SEQ_CST);
+
+	evict_buf(p, vb);
+}
+
+/* Write victim page back after log records of it, and unmap it.
+ * Caller holds latch of partition.
+ */
+static void write_victim(buf_partition * p, Buf * vb) {
+	int i;
+	internal_page * page;
 
 	page = (internal_page *)vb->page;
 	// WAL
-	if (page->page_lsn > 0) {
-		for (i = flushed_num; i < end_num; i++) 
+	pthread_mutex_lock(&log_latch);
+	if (page->page_lsn > flushed_lsn) {
+		for (i = flushed_num + 1; i < end_num; i++) 
 			if (log_buf[i].header->lsn > page->page_lsn)
 				break;
-		//printf("eviction!!!\n");
-		if (i >= 0)
+		if (i >= 0) {
 			flush_log(i);
+			p->stats.wal_flushes++;
+		}
 	}
+	pthread_mutex_unlock(&log_latch);
 
-	if (vb->is_dirty) {
-		write_page(vb->table_id, vb->page, PAGE_SIZE, vb->page_offset);
+	if (vb->is_dirty && vb->page_offset != PAGE_NONE) {
+		write_page(vb->table_id, vb->page, page_size, vb->page_offset);
+		p->stats.writebacks++;
 	}
 		
 	vb->is_dirty = false;
 	vb->in_LRU = false;
-	vb->page_offset = PAGE_NONE;
+	unmap_buf(vb);
+}
 
-	LRU_list->num_lru--;
+/* Write victim page back and free its frame.
+ * Frame cut off by resize is removed instead.
+ * Caller holds latch of partition.
+ */
+static void evict_buf(buf_partition * p, Buf * vb) {
+	p->stats.evictions++;
+	write_victim(p, vb);
+	if (vb->retire)
+		drop_frame(p, vb);
+	else
+		push_free_frame(p, vb - buf);
 }
 
 
-/* Upate LRU.
- * If success return 0. Otherwise, return non_zero value.
+/* Notify replacement policy that page is accessed, and pin it.
+ * If page is newly loaded in frame, register it to policy.
+ * Caller holds latch of partition of frame.
  */
-int update_LRU(Buf * b) {
-	if (LRU_list->num_lru >= num_buf && b->in_LRU == false) {
-		make_victim();
+void touch_buf(Buf * b, ACCESS_TYPE type) {
+	buf_partition * p = &partitions[b->part];
+
+	if (b->in_LRU) {
+		policy->access(p, b, type);
+	} else {
+		policy->admit(p, b, type);
+		b->in_LRU = true;
 	}
 
-	b->lru->buf = b;
-	// If page already exists in buffer.
-	if (b->in_LRU == true) {
-		b->lru->prev->next = b->lru->next;
-		b->lru->next->prev = b->lru->prev;
-		LRU_list->num_lru--;
+	__atomic_add_fetch(&b->pin_count, 1, __ATOMIC_SEQ_CST);
+}
+
+
+// Hash (table_id, page_offset) to slot of page table.
+static int hash_slot(page_hash * h, int table_id, int64_t offset) {
+	uint64_t key;
+	key = ((uint64_t)(offset / page_size) << 8) ^ (uint64_t)table_id;
+	key *= 0x9E3779B97F4A7C15ULL;
+	return (int)(key >> 32) & (h->size - 1);
+}
+
+/* Initialize page table for num frames.
+ * Size of table is at least twice of num
+ * to keep probe sequence short.
+ */
+void init_page_hash(page_hash * h, int num) {
+	int i;
+	h->size = 1;
+	while (h->size < num * 2)
+		h->size <<= 1;
+	h->entries = (hash_entry *)malloc(sizeof(hash_entry) * h->size);
+	for (i = 0; i < h->size; i++)
+		h->entries[i].frame = HASH_EMPTY;
+	h->num_entries = 0;
+}
+
+void free_page_hash(page_hash * h) {
+	free(h->entries);
+	h->entries = NULL;
+	h->size = 0;
+	h->num_entries = 0;
+}
+
+/* Find frame index of page.
+ * If not exist, return HASH_EMPTY.
+ */
+int hash_lookup(page_hash * h, int table_id, int64_t offset) {
+	int i;
+	hash_entry * e;
+
+	i = hash_slot(h, table_id, offset);
+	while (h->entries[i].frame != HASH_EMPTY) {
+		e = &h->entries[i];
+		if (e->table_id == table_id && e->page_offset == offset)
+			return e->frame;
+		i = (i + 1) & (h->size - 1);
 	}
+	return HASH_EMPTY;
+}
 
-	b->lru->next = LRU_list->head->next;
-	LRU_list->head->next->prev = b->lru;
-	b->lru->prev = LRU_list->head;
-	LRU_list->head->next = b->lru;
-	b->in_LRU = true;
+// Register page to frame. If page is already registered, overwrite it.
+void hash_insert(page_hash * h, int table_id, int64_t offset, int frame) {
+	int i;
+	hash_entry * e;
+
+	i = hash_slot(h, table_id, offset);
+	while (h->entries[i].frame != HASH_EMPTY) {
+		e = &h->entries[i];
+		if (e->table_id == table_id && e->page_offset == offset) {
+			e->frame = frame;
+			return;
+		}
+		i = (i + 1) & (h->size - 1);
+	}
+	e = &h->entries[i];
+	e->table_id = table_id;
+	e->page_offset = offset;
+	e->frame = frame;
+	h->num_entries++;
+}
 
-	LRU_list->num_lru++;
-	if (LRU_list->num_lru > num_buf) {
-	//	printf("update_LRU() error!!!!\n");
-		return -1;
+/* Remove page from page table.
+ * Following entries of the probe sequence are shifted back,
+ * so no tombstone is needed.
+ */
+void hash_remove(page_hash * h, int table_id, int64_t offset) {
+	int i, j, home;
+	hash_entry * e;
+
+	i = hash_slot(h, table_id, offset);
+	while (1) {
+		e = &h->entries[i];
+		if (e->frame == HASH_EMPTY)
+			return;
+		if (e->table_id == table_id && e->page_offset == offset)
+			break;
+		i = (i + 1) & (h->size - 1);
 	}
 
-	b->pin_count++;
+	j = i;
+	while (1) {
+		j = (j + 1) & (h->size - 1);
+		e = &h->entries[j];
+		if (e->frame == HASH_EMPTY)
+			break;
+		home = hash_slot(h, e->table_id, e->page_offset);
+		// Entry at j can move to i only if its home is not in (i, j].
+		if ((j > i && (home <= i || home > j)) ||
+				(j < i && (home <= i && home > j))) {
+			h->entries[i] = *e;
+			i = j;
+		}
+	}
+	h->entries[i].frame = HASH_EMPTY;
+	h->num_entries--;
+}
 
-	return 0;
+/* Rebuild page table for num frames.
+ * Entries are inserted again into new table.
+ */
+void rehash_page_hash(page_hash * h, int num) {
+	int i;
+	page_hash old;
+
+	old = *h;
+	init_page_hash(h, num);
+	for (i = 0; i < old.size; i++)
+		if (old.entries[i].frame != HASH_EMPTY)
+			hash_insert(h, old.entries[i].table_id, old.entries[i].page_offset,
+					old.entries[i].frame);
+	free_page_hash(&old);
 }
 
+/* Remove page of buffer frame from page table.
+ * After this, frame doesn't hold any page.
+ */
+void unmap_buf(Buf * b) {
+	buf_partition * p = &partitions[b->part];
+
+	pthread_mutex_lock(&p->latch);
+	if (b->page_offset != PAGE_NONE)
+		hash_remove(&p->page_table, b->table_id, b->page_offset);
+	// Output page of join is not counted.
+	if (b->page_offset >= 0)
+		p->table_frames[b->table_id]--;
+	b->page_offset = PAGE_NONE;
+	pthread_mutex_unlock(&p->latch);
+}
 
 /* Find Buf structure of its offset.
  * If exist, return buf pointer.
  * If not, return NULL
  */
-Buf * find_buf(int table_id, int64_t offset) {
+Buf * find_buf(buf_partition * p, int table_id, int64_t offset, ACCESS_TYPE type) {
 	int i;
 
-	// Find page in buffer pool.
-	for (i = 0; i < num_buf; i++) {
-		if (buf[i].table_id == table_id && buf[i].page_offset == offset) {
-			update_LRU(&buf[i]);
-			return &buf[i];
-		}
-	}
-
-	// If not exist
-	return NULL;
+	// Find page in page table.
+	// Page being read by read-ahead is used after its read ends.
+	while ((i = hash_lookup(&p->page_table, table_id, offset)) != HASH_EMPTY &&
+			buf[i].io_pending)
+		pthread_cond_wait(&p->cond, &p->latch);
+	if (i == HASH_EMPTY)
+		return NULL;
+
+	p->stats.hits++;
+	touch_buf(&buf[i], type);
+	return &buf[i];
 }
 
 
-int get_free_buffer_index(void) {
+// Push index of frame which doesn't hold page.
+void push_free_frame(buf_partition * p, int i) {
+	p->free_frames[p->num_free++] = i;
+}
+
+/* Reserve frame for page read by read-ahead or warm-up.
+ * Frame is pinned and marked io_pending until complete_frame,
+ * so other threads wait for the page instead of reading it again.
+ * Unlike make_victim, it never waits for unpinned page.
+ * If evict is false, only free frame is used.
+ * If page is in buffer, *b is NULL and return 0.
+ * If frame is reserved, *b is the frame and return 0.
+ * If no frame can be used, return -1.
+ */
+int reserve_frame(int table_id, int64_t offset, bool evict, Buf ** b) {
 	int i;
-	// If buffer is full
-	if (LRU_list->num_lru == num_buf) {
-		make_victim();
-		for (i = 0; i < num_buf; i++) {
-			if (buf[i].page_offset == PAGE_NONE) {
-				break;
-			}
-		}
-	}   // If not
-	else {
-		for (i = 0; i < num_buf; i++) {
-			if (buf[i].page_offset == PAGE_NONE) {
-				break;
-			}
+	Buf * vb;
+	buf_partition * p;
+
+	*b = NULL;
+	p = get_partition(table_id, offset);
+	pthread_mutex_lock(&p->latch);
+	if (hash_lookup(&p->page_table, table_id, offset) != HASH_EMPTY) {
+		pthread_mutex_unlock(&p->latch);
+		return 0;
+	}
+	while (p->num_free == 0) {
+		if (!evict || (vb = choose_victim(p, table_id)) == NULL) {
+			pthread_mutex_unlock(&p->latch);
+			return -1;
 		}
+		evict_buf(p, vb);
 	}
 
-	return i;
+	i = p->free_frames[--p->num_free];
+	*b = &buf[i];
+	(*b)->table_id = table_id;
+	(*b)->page_offset = offset;
+	(*b)->is_dirty = false;
+	(*b)->pin_count = 1;
+	(*b)->io_pending = true;
+	hash_insert(&p->page_table, table_id, offset, i);
+	p->table_frames[table_id]++;
+	p->stats.prefetches++;
+	pthread_mutex_unlock(&p->latch);
+	return 0;
+}
+
+// Finish read of frame reserved by reserve_frame and wake up waiters.
+void complete_frame(Buf * b, ACCESS_TYPE type) {
+	buf_partition * p = &partitions[b->part];
+
+	pthread_mutex_lock(&p->latch);
+	b->io_pending = false;
+	policy->admit(p, b, type);
+	b->in_LRU = true;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->latch);
+	release_pincount(b);
+}
+
+/* Drop frame reserved by reserve_frame whose read failed.
+ * Frame is freed, and waiters read the page by themselves.
+ */
+void cancel_frame(Buf * b) {
+	buf_partition * p = &partitions[b->part];
+
+	pthread_mutex_lock(&p->latch);
+	unmap_buf(b);
+	b->io_pending = false;
+	b->pin_count = 0;
+	if (b->retire)
+		drop_frame(p, b);
+	else
+		push_free_frame(p, b - buf);
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->latch);
+}
+
+/* Pop index of free frame.
+ * If there is no free frame, make victim first.
+ */
+int get_free_buffer_index(buf_partition * p, int table_id) {
+	// If buffer is full. Frame cut off by resize is not freed by eviction.
+	while (p->num_free == 0)
+		make_victim(p, table_id);
+
+	return p->free_frames[--p->num_free];
 }
 
-void alloc_freepage(int table_id, Buf * hb, int64_t offset) {
+void alloc_freepage(int table_id, int64_t offset) {
 	int64_t free_offset;
-	header_page * hp;
+	table_desc * d;
 	free_page * fp;
 
 	free_offset = offset;
-	hp = (header_page *)hb->page;
-	fp = (free_page *)malloc(sizeof(free_page));
-	read_page(table_id, (Page *)fp, PAGE_SIZE, offset);
+	d = &descs[table_id];
+	// Page past end of file is read as zero, so it is free.
+	fp = (free_page *)calloc(1, page_size);
+	read_page(table_id, (Page *)fp, page_size, offset);
 
 	if (fp->next_page == 0) {
 		// If next freepage doesn't exist
 		while (1) {
-			free_offset += PAGE_SIZE;
-			read_page(table_id, (Page *)fp, PAGE_SIZE, free_offset);
-			if (fp->next_page == 0 && hp->root_page != free_offset) {
-				hp->free_page = free_offset;
+			free_offset += page_size;
+			memset(fp, 0, page_size);
+			read_page(table_id, (Page *)fp, page_size, free_offset);
+			if (fp->next_page == 0 && d->root_page != free_offset) {
+				d->free_page = free_offset;
 				break;
 			}
 		}
 	} else {
 		// If next freepage exists
-		hp->free_page = fp->next_page;
+		d->free_page = fp->next_page;
 	}
 
-	hp->num_pages++;
-	mark_dirty(hb);
-	release_pincount(hb);
+	d->num_pages++;
+	d->dirty = true;
 	free(fp);
 }
 
 /* Make Buf structure
+ * Caller holds latch of partition.
  */
 
-Buf * make_buf(int table_id, int64_t offset) {
-	Buf * hb;
+Buf * make_buf(buf_partition * p, int table_id, int64_t offset, ACCESS_TYPE type) {
 	int buf_idx;
-	header_page * hp;
-
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *)hb->page;
 
-	buf_idx = get_free_buffer_index();
+	buf_idx = get_free_buffer_index(p, table_id);
+	p->stats.misses++;
 	// If free page assigned
-	if (hp->free_page == offset) {
-		alloc_freepage(table_id, hb, offset);
+	if (descs[table_id].free_page == offset) {
+		alloc_freepage(table_id, offset);
 	} else {
 		// If read page first
-		read_page(table_id, buf[buf_idx].page, PAGE_SIZE, offset);
+		read_page(table_id, buf[buf_idx].page, page_size, offset);
 	}
 
 	buf[buf_idx].page_offset = offset;
 	buf[buf_idx].table_id = table_id;
 	buf[buf_idx].is_dirty = false;
-	if (update_LRU(&buf[buf_idx]) != 0) {
-		//printf("make_buf(update_LRU)) error!!!\n");
-	}
-
-	release_pincount(hb);
+	hash_insert(&p->page_table, table_id, offset, buf_idx);
+	p->table_frames[table_id]++;
+	touch_buf(&buf[buf_idx], type);
 
 	return &buf[buf_idx];
 }
@@ -314,154 +1036,658 @@ Buf * make_buf(int table_id, int64_t offset) {
  * If not, assign Buf and read page of its offset.
  */
 Buf * get_buf(int table_id, int64_t offset) {
+	return get_buf_access(table_id, offset, ACCESS_RANDOM);
+}
+
+/* Get Buf structure of leaf page read by leaf chain scan.
+ * Page stays at cold end of replacement policy.
+ */
+Buf * get_buf_scan(int table_id, int64_t offset) {
+	return get_buf_access(table_id, offset, ACCESS_SCAN);
+}
+
+Buf * get_buf_access(int table_id, int64_t offset, ACCESS_TYPE type) {
 	Buf * b;
+	buf_partition * p;
+
+	p = get_partition(table_id, offset);
+	pthread_mutex_lock(&p->latch);
+	// If page is first read, read page.
+	if ((b = find_buf(p, table_id, offset, type)) == NULL) {
+		if (offset == HEADERPAGE_OFFSET)
+			b = read_headerpage(p, table_id);
+		else
+			b = make_buf(p, table_id, offset, type);
+	}
+	pthread_mutex_unlock(&p->latch);
 
-	if ((b = find_buf(table_id, offset)) != NULL)
-		return b;
+	readahead_hint(table_id, b, type);
+	return b;
+}
 
-	if (offset == 0) {
-		return read_headerpage(table_id);	
+/* Read header page of table file.
+ * Page size saved in it must be page size of database.
+ * If success, return 0. Otherwise, return -1.
+ */
+static int read_header(int fd, char * pathname, header_page * hp) {
+	int64_t size;
+
+	if (pread(fd, hp, sizeof(header_page), HEADERPAGE_OFFSET) != sizeof(header_page)) {
+		printf("open_table() error : %s is not a table\n", pathname);
+		return -1;
+	}
+	size = hp->page_size == 0 ? DEFAULT_PAGE_SIZE : hp->page_size;
+	if (size != page_size) {
+		printf("open_table() error : page size of %s is %" PRId64 ", not %d\n",
+				pathname, size, page_size);
+		return -1;
 	}
-	// If page is first read, read page
-	return make_buf(table_id, offset);
+	return 0;
+}
+
+/* Open existing data file read only and map it.
+ * Pages are read from mapping, so OS page cache is the only cache
+ * and processes which map the same file share it.
+ */
+static int map_table(int table_id, char * pathname) {
+	int fd;
+	struct stat st;
+	char * map;
+	header_page hp;
+
+	if ((fd = open(pathname, O_RDONLY)) == -1) {
+		printf("open_table() error : fail to open %s\n", pathname);
+		return -1;
+	}
+	if (read_header(fd, pathname, &hp) != 0) {
+		close(fd);
+		return -1;
+	}
+	// Mapping is read only, so leaves of old format are not converted.
+	if (hp.leaf_format != LEAF_SPLIT) {
+		printf("open_table() error : leaves of %s are old format, open it read write once\n", pathname);
+		close(fd);
+		return -1;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size < 2 * page_size) {
+		printf("open_table() error : %s is not a table\n", pathname);
+		close(fd);
+		return -1;
+	}
+	map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		printf("open_table() error : fail to map %s\n", pathname);
+		close(fd);
+		return -1;
+	}
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	table[table_id] = fd;
+	table_map[table_id] = map;
+	table_map_size[table_id] = st.st_size;
+	pthread_rwlock_unlock(&table_latch[table_id]);
+	return table_id;
 }
 
 /* Open existing data file using ‘pathname’ or create one if not existed.
  * If success, return table_id. Otherwise, return -1.
  */
 int open_table(char* pathname) {
+	return open_table_with_mode(pathname, TABLE_READ_WRITE);
+}
+
+/* open_table with buffer pool quota of table.
+ * If table is already opened, its quota is changed.
+ */
+int open_table_with_quota(char * pathname, table_quota * quota) {
+	int table_id;
+
+	if ((table_id = open_table(pathname)) == -1)
+		return -1;
+	if (set_table_quota(table_id, quota) != 0) {
+		close_table(table_id);
+		return -1;
+	}
+	return table_id;
+}
+
+/* open_table with mode.
+ * TABLE_MMAP opens existing table read only.
+ * If table is already opened, its mode is not changed.
+ */
+int open_table_with_mode(char * pathname, TABLE_MODE mode) {
 	int fd;
 	int table_id;
-	header_page * hp;
+	header_page * hp, header;
 	Buf * hb;
 
 	table_id = atoi(&pathname[4]);
+	if (mode == TABLE_MMAP) {
+		if (table[table_id] != 0)
+			return table_id;
+		return map_table(table_id, pathname);
+	}
 
 	// If file exists
 	if (access(pathname, 0) == 0) {
 		if (table[table_id] != 0)
 			return table_id;
-		if ((fd = open(pathname, O_RDWR | O_SYNC, 0644)) == -1) {
+		if ((fd = open(pathname, O_RDWR | sync_flags(), 0644)) == -1) {
 			// Fail to access
 			return -1;
+		} else if (read_header(fd, pathname, &header) != 0) {
+			close(fd);
+			return -1;
 		} else {
+			// Read-ahead of closed table may still use this table id.
+			pthread_rwlock_wrlock(&table_latch[table_id]);
 			table[table_id] = fd;
+			load_table_desc(table_id, &header);
+			// Redo may write old images of leaves, so recovery links and converts them after.
+			if (!recovering && header.left_linked == 0)
+				link_leaves(table_id);
+			if (!recovering && header.leaf_format != LEAF_SPLIT)
+				convert_leaves(table_id);
+			pthread_rwlock_unlock(&table_latch[table_id]);
+			request_warmup(table_id);
 			return table_id;
 		}
 	} else {
 		// If file doesn't exist, make file and initialize header page and write into file.
-		if ((fd = open(pathname, O_CREAT | O_RDWR | O_SYNC, 0644)) == -1) {
+		if ((fd = open(pathname, O_CREAT | O_RDWR | sync_flags(), 0644)) == -1) {
 			// Fail to make file.
 			return -1;
 		} else {
+			pthread_rwlock_wrlock(&table_latch[table_id]);
 			table[table_id] = fd;
 			// Success to make file, initialize header page and write into file.
 			hb = init_headerpage(table_id);
 			hp = (header_page *)hb->page;
-			hp->free_page = PAGE_SIZE;
+			memset(hp, 0, page_size);
+			hp->page_size = page_size;
+			hp->free_page = page_size;
 			hp->root_page = 0;
 			hp->num_pages = 1;	// header page
+			hp->left_linked = 1;
+			hp->leaf_format = LEAF_SPLIT;
+			load_table_desc(table_id, hp);
 			// Make root page.
 			// First root page is leaf page.
-			Buf * b = get_buf(table_id, hp->free_page);
+			Buf * b = get_buf(table_id, descs[table_id].free_page);
 			leaf_page * root = (leaf_page *) b->page;
 			root->parent_page = 0;
-			root->is_leaf = 1;
-			root->num_keys = 0;
+			init_leaf(root);
 			root->right_sibling = 0;
+			root->left_sibling = 0;
 
-			hp->root_page = b->page_offset;
+			descs[table_id].root_page = b->page_offset;
 
-			hp->num_pages++;
+			descs[table_id].num_pages++;
+			descs[table_id].dirty = true;
 			// write page into disk
 			mark_dirty(b);
-			mark_dirty(hb);
-
 			release_pincount(b);
 			release_pincount(hb);
+			store_table_desc(table_id);
+			pthread_rwlock_unlock(&table_latch[table_id]);
 			return table_id;
 		}
 	}
 }
 				
-int close_table(int table_id) {
-	LRU * cur;
-	cur = LRU_list->head->next;
-	while (cur != LRU_list->tail) {
-		if (cur->buf->table_id == table_id) {
-			Buf * vb;
-			// Remove in LRU_list.
-			cur->prev->next = cur->next;
-			cur->next->prev = cur->prev;
-
-			vb = cur->buf;
-
-			if (vb->is_dirty && vb->page_offset != PAGE_NONE) {
-				write_page(vb->table_id, vb->page, PAGE_SIZE, vb->page_offset);
-			}
+static int compare_frame(const void * a, const void * b) {
+	Buf * x = *(Buf * const *)a;
+	Buf * y = *(Buf * const *)b;
+
+	if (x->table_id != y->table_id)
+		return x->table_id < y->table_id ? -1 : 1;
+	return x->page_offset < y->page_offset ? -1 : x->page_offset > y->page_offset;
+}
+
+/* Write dirty pages of table back, or of every table if table_id is 0.
+ * Pages are sorted by (table_id, page_offset), and pages next to
+ * each other in file are written by one vectored request.
+ * Pages are pinned until written, so other threads don't evict them.
+ * Caller keeps pages from being changed meanwhile.
+ * If write fails, its pages stay dirty.
+ * If success, return the number of written pages. Otherwise, return -1.
+ */
+int flush_dirty_pages(int table_id) {
+	int i, j, k, n, num_req, result;
+	Buf ** dirty, * b;
+	struct iovec * iov;
+	io_request * reqs, * last;
+	buf_partition * p;
+
+	// Header page is written with changed descriptor.
+	for (i = 1; i < 11; i++)
+		if ((table_id == 0 || table_id == i) && table[i] != 0)
+			store_table_desc(i);
+
+	// Frames waiting to retire are beyond num_buf.
+	dirty = (Buf **)malloc(sizeof(Buf *) * max_buf);
+	n = 0;
+	for (j = 0; j < num_partitions; j++) {
+		p = &partitions[j];
+		pthread_mutex_lock(&p->latch);
+		// Page being written by page cleaner is not written twice.
+		while (p->cleaner_writing)
+			pthread_cond_wait(&p->cond, &p->latch);
+		for (i = 0; i < p->num_frames; i++) {
+			b = &buf[p->frames[i]];
+			if (!b->in_LRU || !b->is_dirty || b->page_offset < HEADERPAGE_OFFSET)
+				continue;
+			if (table_id != 0 && b->table_id != table_id)
+				continue;
+			__atomic_add_fetch(&b->pin_count, 1, __ATOMIC_SEQ_CST);
+			b->is_dirty = false;
+			dirty[n++] = b;
+			p->stats.writebacks++;
+		}
+		pthread_mutex_unlock(&p->latch);
+	}
+	qsort(dirty, n, sizeof(Buf *), compare_frame);
+
+	iov = (struct iovec *)malloc(sizeof(struct iovec) * (n + 1));
+	reqs = (io_request *)malloc(sizeof(io_request) * (n + 1));
+	num_req = 0;
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = dirty[i]->page;
+		iov[i].iov_len = page_size;
+		last = num_req > 0 ? &reqs[num_req - 1] : NULL;
+		if (last != NULL && last->table_id == dirty[i]->table_id && last->num < FLUSH_RUN_MAX &&
+				last->offset + (int64_t)last->num * page_size == dirty[i]->page_offset) {
+			last->num++;
+			continue;
+		}
+		reqs[num_req].table_id = dirty[i]->table_id;
+		reqs[num_req].offset = dirty[i]->page_offset;
+		reqs[num_req].iov = &iov[i];
+		reqs[num_req].num = 1;
+		reqs[num_req].write = true;
+		num_req++;
+	}
+	io->submit(reqs, num_req);
+	result = n;
+	for (i = 0; i < num_req; i++) {
+		if (reqs[i].result == (ssize_t)reqs[i].num * page_size)
+			continue;
+		for (j = reqs[i].iov - iov, k = 0; k < reqs[i].num; k++)
+			dirty[j + k]->is_dirty = true;
+		result = -1;
+	}
+	if (result < 0)
+		printf("flush_dirty_pages() error : fail to write pages\n");
+	for (i = 0; i < n; i++)
+		release_pincount(dirty[i]);
+
+	free(dirty);
+	free(iov);
+	free(reqs);
+	return result;
+}
+
+// Open flag of data and log files in durability mode of config.
+int sync_flags(void) {
+	return config.durability == DURABILITY_STRICT ? O_SYNC : 0;
+}
+
+/* Make pages written to table durable.
+ * Only WAL mode needs it. In strict mode, every write is synchronous.
+ */
+void sync_table(int table_id) {
+	if (config.durability == DURABILITY_WAL && table[table_id] != 0 && table_map[table_id] == NULL)
+		fdatasync(table[table_id]);
+}
+
+void sync_tables(void) {
+	int i;
+
+	for (i = 1; i < 11; i++) {
+		pthread_rwlock_rdlock(&table_latch[i]);
+		sync_table(i);
+		pthread_rwlock_unlock(&table_latch[i]);
+	}
+}
+
+/* Write every dirty page back and make it durable.
+ * Log is flushed first, so log of every written page is on disk.
+ * Trees are not changed while checkpoint is made.
+ * If success, return 0. Otherwise, return -1.
+ */
+int checkpoint(void) {
+	int i, result;
+
+	for (i = 0; i < 11; i++)
+		pthread_rwlock_wrlock(&table_latch[i]);
+	pthread_mutex_lock(&log_latch);
+	if (end_num != LOG_INIT_NUM)
+		flush_log(end_num);
+	pthread_mutex_unlock(&log_latch);
+
+	result = flush_dirty_pages(0) < 0 ? -1 : 0;
+	for (i = 1; i < 11; i++)
+		sync_table(i);
+	for (i = 10; i >= 0; i--)
+		pthread_rwlock_unlock(&table_latch[i]);
+	return result;
+}
+
+/* Remove every page of table from buffer pool without writing it.
+ * Caller holds write latch of table.
+ */
+void drop_table_pages(int table_id) {
+	int i, j;
+	Buf * vb;
+	buf_partition * p;
+
+	for (j = 0; j < num_partitions; j++) {
+		p = &partitions[j];
+		pthread_mutex_lock(&p->latch);
+		// Wait until page cleaner releases its pages.
+		while (p->cleaner_writing)
+			pthread_cond_wait(&p->cond, &p->latch);
+
+		for (i = 0; i < p->num_frames; i++) {
+			vb = &buf[p->frames[i]];
+			if (!vb->in_LRU || vb->table_id != table_id)
+				continue;
+
+			// Remove in replacement policy.
+			policy->remove(p, vb);
 
 			vb->is_dirty = false;
 			vb->in_LRU = false;
-			vb->page_offset = PAGE_NONE;
+			unmap_buf(vb);
 			vb->pin_count = 0;
-
-			LRU_list->num_lru--;
+			push_free_frame(p, p->frames[i]);
 		}
-		cur = cur->next;
+		pthread_mutex_unlock(&p->latch);
+	}
+}
+
+int close_table(int table_id) {
+	table_quota quota;
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	default_table_quota(&quota);
+	set_table_quota(table_id, &quota);
+	// Mapped table has no page in buffer pool.
+	if (table_map[table_id] != NULL) {
+		munmap(table_map[table_id], table_map_size[table_id]);
+		table_map[table_id] = NULL;
+		close(table[table_id]);
+		table[table_id] = 0;
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return 0;
 	}
+	flush_dirty_pages(table_id);
+	sync_table(table_id);
+	drop_table_pages(table_id);
 	close(table[table_id]);
 	table[table_id] = 0;
+	reset_readahead(table_id);
+	pthread_rwlock_unlock(&table_latch[table_id]);
 	return 0;
 }
 
 int shutdown_db() {
 	int i;
-	LRU * cur;
-	cur = LRU_list->head->next;
-	while (cur != LRU_list->tail) {
-		Buf * vb;
-		if (!vb->in_LRU) {
-			cur = cur->next;
-			continue;
-		}
-		// Remove in LRU_list.
-		cur->prev->next = cur->next;
-		cur->next->prev = cur->prev;
-
-		vb = cur->buf;
+	Buf * vb;
 
-		if (vb->is_dirty && vb->page_offset != PAGE_NONE) {
-			write_page(vb->table_id, vb->page, PAGE_SIZE, vb->page_offset);
-		}
+	stop_page_cleaner();
+	stop_readahead();
+	stop_warmup();
+	if (config.warmup)
+		save_warm_pages();
+
+	flush_dirty_pages(0);
+	for (i = 1; i < 11; i++)
+		sync_table(i);
+	// Frames waiting to retire are beyond num_buf.
+	for (i = 0; i < max_buf; i++) {
+		vb = &buf[i];
+		if (!vb->in_LRU)
+			continue;
 
 		vb->is_dirty = false;
 		vb->in_LRU = false;
-		vb->page_offset = PAGE_NONE;
-
-		LRU_list->num_lru--;
-
-		cur = cur->next;
+		unmap_buf(vb);
 	}
 
-	for (i = 0; i < num_buf; i++) {
-		free(buf[i].page);
-		free(buf[i].lru);
-	}
-	free(buf);
-	free(LRU_list);
+	for (i = 0; i < num_partitions; i++)
+		free_partition(&partitions[i]);
+	free(partitions);
+	free_frame_arena();
+	pthread_mutex_destroy(&cleaner_latch);
+	pthread_cond_destroy(&cleaner_cond);
+	pthread_mutex_destroy(&warm_latch);
+	pthread_cond_destroy(&warm_cond);
+	pthread_mutex_destroy(&ra_latch);
+	pthread_cond_destroy(&ra_cond);
+	for (i = 0; i < 11; i++)
+		pthread_rwlock_destroy(&table_latch[i]);
 	for (i = 0; i < LOG_BUFFER_SIZE; i++) {
 		free(log_buf[i].header);
 		free(log_buf[i].old_image);
 		free(log_buf[i].new_image);
 	}
 	free(log_buf);
+	pthread_mutex_destroy(&log_latch);
 
 	for (i = 1; i < 11; i++) {
-		close(i);
+		if (table_map[i] != NULL)
+			munmap(table_map[i], table_map_size[i]);
+		table_map[i] = NULL;
+		if (table[i] != 0)
+			close(table[i]);
 		table[i] = 0;
 	}
-	if (LRU_list->num_lru == 0) {
+	destroy_io();
+	return 0;
+}
+
+// STATISTICS
+
+// Sum counters of every partition.
+void get_db_stats(db_stats * stats) {
+	int i;
+	buf_partition * p;
+
+	memset(stats, 0, sizeof(db_stats));
+	for (i = 0; i < num_partitions; i++) {
+		p = &partitions[i];
+		pthread_mutex_lock(&p->latch);
+		stats->buf.hits += p->stats.hits;
+		stats->buf.misses += p->stats.misses;
+		stats->buf.evictions += p->stats.evictions;
+		stats->buf.writebacks += p->stats.writebacks;
+		stats->buf.pin_waits += p->stats.pin_waits;
+		stats->buf.wal_flushes += p->stats.wal_flushes;
+		stats->buf.prefetches += p->stats.prefetches;
+		pthread_mutex_unlock(&p->latch);
+	}
+	for (i = 0; i < 11; i++) {
+		stats->bytes_read[i] = __atomic_load_n(&table_bytes_read[i], __ATOMIC_RELAXED);
+		stats->bytes_written[i] = __atomic_load_n(&table_bytes_written[i], __ATOMIC_RELAXED);
+	}
+}
+
+void reset_db_stats(void) {
+	int i;
+	buf_partition * p;
+
+	for (i = 0; i < num_partitions; i++) {
+		p = &partitions[i];
+		pthread_mutex_lock(&p->latch);
+		memset(&p->stats, 0, sizeof(buf_stats));
+		pthread_mutex_unlock(&p->latch);
+	}
+	for (i = 0; i < 11; i++) {
+		__atomic_store_n(&table_bytes_read[i], 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&table_bytes_written[i], 0, __ATOMIC_RELAXED);
+	}
+}
+
+void print_db_stats(void) {
+	int i;
+	db_stats stats;
+	int64_t total;
+
+	get_db_stats(&stats);
+	total = stats.buf.hits + stats.buf.misses;
+	printf("buffer : %d frames, %d partitions\n", num_buf, num_partitions);
+	printf("hits %" PRId64 ", misses %" PRId64 ", hit ratio %.2f%%\n",
+			stats.buf.hits, stats.buf.misses, total ? 100.0 * stats.buf.hits / total : 0.0);
+	printf("evictions %" PRId64 ", dirty write-backs %" PRId64 ", pin waits %" PRId64 "\n",
+			stats.buf.evictions, stats.buf.writebacks, stats.buf.pin_waits);
+	printf("WAL log flushes %" PRId64 ", prefetched pages %" PRId64 "\n",
+			stats.buf.wal_flushes, stats.buf.prefetches);
+	for (i = 1; i < 11; i++) {
+		if (stats.bytes_read[i] == 0 && stats.bytes_written[i] == 0)
+			continue;
+		printf("table %d : read %" PRId64 " bytes, written %" PRId64 " bytes\n",
+				i, stats.bytes_read[i], stats.bytes_written[i]);
+	}
+	fflush(stdout);
+}
+
+// PAGE CLEANER
+
+/* Write dirty pages at cold end of replacement policy of partition.
+ * Page is copied while latch is held and written without latch,
+ * so miss in other thread doesn't wait for the write.
+ * Tree changes pages under table latch, so page is copied under its
+ * read latch. Page of table being changed is skipped, not waited for.
+ * Page which needs log flush (WAL) is left to make_victim.
+ * Return the number of written pages.
+ */
+static int clean_partition(buf_partition * p) {
+	int i, num_cold, num_clean, max_clean;
+	Buf * cold[CLEANER_DEPTH];
+	Buf * clean[CLEANER_BATCH];
+	static Page copy[CLEANER_BATCH];
+	struct iovec iov[CLEANER_BATCH];
+	io_request reqs[CLEANER_BATCH];
+	internal_page * page;
+	int64_t lsn;
+
+	pthread_mutex_lock(&p->latch);
+	lsn = __atomic_load_n(&flushed_lsn, __ATOMIC_ACQUIRE);
+	num_cold = policy->cold_pages(p, cold, CLEANER_DEPTH);
+	num_clean = 0;
+	// Leave most of frames to be used while cleaner writes.
+	max_clean = p->num_frames / 4 < CLEANER_BATCH ? p->num_frames / 4 : CLEANER_BATCH;
+	for (i = 0; i < num_cold && num_clean < max_clean; i++) {
+		page = (internal_page *)cold[i]->page;
+		if (!cold[i]->is_dirty || cold[i]->page_offset < 0)
+			continue;
+		if (pthread_rwlock_tryrdlock(&table_latch[cold[i]->table_id]) != 0)
+			continue;
+		if (page->page_lsn > lsn) {
+			pthread_rwlock_unlock(&table_latch[cold[i]->table_id]);
+			continue;
+		}
+		// Pin page, so it is not read again before write ends.
+		__atomic_add_fetch(&cold[i]->pin_count, 1, __ATOMIC_SEQ_CST);
+		memcpy(&copy[num_clean], cold[i]->page, page_size);
+		cold[i]->is_dirty = false;
+		pthread_rwlock_unlock(&table_latch[cold[i]->table_id]);
+		// Page may be freed by tree while it is written.
+		iov[num_clean].iov_base = &copy[num_clean];
+		iov[num_clean].iov_len = page_size;
+		reqs[num_clean].table_id = cold[i]->table_id;
+		reqs[num_clean].offset = cold[i]->page_offset;
+		reqs[num_clean].iov = &iov[num_clean];
+		reqs[num_clean].num = 1;
+		reqs[num_clean].write = true;
+		clean[num_clean++] = cold[i];
+	}
+	p->stats.writebacks += num_clean;
+	p->cleaner_writing = (num_clean > 0);
+	pthread_mutex_unlock(&p->latch);
+
+	if (num_clean == 0)
 		return 0;
+
+	// Pages are written by one batch.
+	io->submit(reqs, num_clean);
+
+	pthread_mutex_lock(&p->latch);
+	for (i = 0; i < num_clean; i++)
+		__atomic_sub_fetch(&clean[i]->pin_count, 1, __ATOMIC_SEQ_CST);
+	p->cleaner_writing = false;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->latch);
+
+	return num_clean;
+}
+
+// Clean every partition. Return the largest number of written pages.
+int clean_pages(void) {
+	int i, n, max = 0;
+
+	for (i = 0; i < num_partitions; i++)
+		if ((n = clean_partition(&partitions[i])) > max)
+			max = n;
+	return max;
+}
+
+/* Page cleaner thread.
+ * It also saves resident pages for warm-up at every checkpoint_interval.
+ */
+void * page_cleaner(void * arg) {
+	struct timespec ts, now, checkpoint;
+
+	clock_gettime(CLOCK_MONOTONIC, &checkpoint);
+	pthread_mutex_lock(&cleaner_latch);
+	while (cleaner_running) {
+		pthread_mutex_unlock(&cleaner_latch);
+		// If cleaner wrote full batch, more dirty pages may be waiting.
+		if (config.page_cleaner)
+			while (clean_pages() >= CLEANER_BATCH && cleaner_running)
+				;
+		if (config.checkpoint_interval > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - checkpoint.tv_sec) * 1000 +
+					(now.tv_nsec - checkpoint.tv_nsec) / 1000000 >= config.checkpoint_interval) {
+				if (config.warmup)
+					save_warm_pages();
+				// Pages written by cleaner become durable.
+				sync_tables();
+				checkpoint = now;
+			}
+		}
+		pthread_mutex_lock(&cleaner_latch);
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += config.cleaner_interval / 1000;
+		ts.tv_nsec += (config.cleaner_interval % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		if (cleaner_running)
+			pthread_cond_timedwait(&cleaner_cond, &cleaner_latch, &ts);
 	}
-	return -1;
+	pthread_mutex_unlock(&cleaner_latch);
+	return NULL;
+}
+
+void start_page_cleaner(void) {
+	cleaner_running = true;
+	if (pthread_create(&cleaner_thread, NULL, page_cleaner, NULL) != 0) {
+		printf("fail to start page cleaner\n");
+		cleaner_running = false;
+	}
+}
+
+void stop_page_cleaner(void) {
+	if (!cleaner_running)
+		return;
+	pthread_mutex_lock(&cleaner_latch);
+	cleaner_running = false;
+	pthread_cond_broadcast(&cleaner_cond);
+	pthread_mutex_unlock(&cleaner_latch);
+	pthread_join(cleaner_thread, NULL);
 }
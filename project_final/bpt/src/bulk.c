@@ -0,0 +1,370 @@
+/**
+ *		@class Database System
+ *		@file  bulk.c
+ *		@brief Bulk load of sorted records
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+/* Empty table is built from sorted records without descending tree.
+ * Leaves are filled up to fill factor and written in key order,
+ * so file is written sequentially. Bottom internal page takes
+ * the page slot before its second leaf, so parent of every leaf
+ * is known when leaf is written. Other internal pages are few,
+ * so they are built after leaves and written after them.
+ * New pages are put after end of file and header page is
+ * written last, so table has old root until load completes.
+ * Records are not logged.
+ */
+
+// Child of internal page being built.
+typedef struct bulk_child {
+	int64_t key;		// Smallest key below child.
+	int64_t offset;
+} bulk_child;
+
+typedef struct bulk_state {
+	int table_id;
+	int leaf_fill;			// Number of records of full leaf.
+	int internal_fill;		// Number of children of full internal page.
+	int64_t next_offset;		// Offset of next new page.
+	leaf_page * prev, * cur;	// Last two leaves. They are balanced at end.
+	bulk_child * leaves;		// First key and offset of every leaf.
+	int num_leaves, max_leaves;
+	int64_t * bottom;		// Offset of every bottom internal page.
+	int num_bottom, max_bottom;
+	int last_start;			// Index of first leaf below last bottom page.
+	char * batch;			// Contiguous pages written at once.
+	int batch_num;
+	int64_t batch_offset;
+	Page * page;			// Internal page being written.
+	int result;
+} bulk_state;
+
+// Write pages in batch.
+static void flush_batch(bulk_state * s) {
+	struct iovec iov;
+
+	if (s->batch_num == 0)
+		return;
+	iov.iov_base = s->batch;
+	iov.iov_len = (size_t)s->batch_num * page_size;
+	if (submit_io(s->table_id, &iov, 1, s->batch_offset, true) != 0)
+		s->result = -1;
+	s->batch_num = 0;
+}
+
+// Add page to batch. Batch is written if page doesn't follow it.
+static void write_bulk_page(bulk_state * s, Page * page, int64_t offset) {
+	if (s->batch_num > 0 && (s->batch_num == BULK_BATCH ||
+				s->batch_offset + (int64_t)s->batch_num * page_size != offset))
+		flush_batch(s);
+	if (s->batch_num == 0)
+		s->batch_offset = offset;
+	memcpy(s->batch + (size_t)s->batch_num * page_size, page, page_size);
+	s->batch_num++;
+}
+
+// Bottom internal page which is parent of leaf i.
+static int64_t leaf_parent(bulk_state * s, int i) {
+	if (i >= s->last_start)
+		return s->bottom[s->num_bottom - 1];
+	return s->bottom[i / s->internal_fill];
+}
+
+static void write_leaf(bulk_state * s, leaf_page * leaf, int i) {
+	leaf->parent_page = s->num_leaves > 1 ? leaf_parent(s, i) : 0;
+	write_bulk_page(s, (Page *)leaf, s->leaves[i].offset);
+}
+
+/* Start new leaf after current one.
+ * Leaf before current one is written, because
+ * only last two leaves are changed at end.
+ */
+static void next_leaf(bulk_state * s) {
+	int i = s->num_leaves;
+	leaf_page * tmp;
+
+	// Single leaf is root, so first bottom page waits for second leaf.
+	if ((i == 1 || (i > 1 && i % s->internal_fill == 0))) {
+		if (s->num_bottom == s->max_bottom) {
+			s->max_bottom = s->max_bottom * 2 + 16;
+			s->bottom = (int64_t *)realloc(s->bottom, sizeof(int64_t) * s->max_bottom);
+		}
+		s->last_start = i == 1 ? 0 : i;
+		s->bottom[s->num_bottom++] = s->next_offset;
+		s->next_offset += page_size;
+	}
+	if (i == s->max_leaves) {
+		s->max_leaves = s->max_leaves * 2 + 64;
+		s->leaves = (bulk_child *)realloc(s->leaves, sizeof(bulk_child) * s->max_leaves);
+	}
+	s->leaves[i].offset = s->next_offset;
+	s->next_offset += page_size;
+
+	if (i >= 2)
+		write_leaf(s, s->prev, i - 2);
+	if (i >= 1) {
+		s->cur->right_sibling = s->leaves[i].offset;
+		tmp = s->prev;
+		s->prev = s->cur;
+		s->cur = tmp;
+	}
+	memset(s->cur, 0, page_size);
+	init_leaf(s->cur);
+	if (i >= 1)
+		s->cur->left_sibling = s->leaves[i - 1].offset;
+	s->num_leaves++;
+}
+
+static void add_record(bulk_state * s, int64_t key, char * value) {
+	leaf_page * leaf;
+
+	if (s->num_leaves == 0 || s->cur->num_keys == s->leaf_fill)
+		next_leaf(s);
+	leaf = s->cur;
+	if (leaf->num_keys == 0)
+		s->leaves[s->num_leaves - 1].key = key;
+	insert_into_leaf_at(leaf, leaf->num_keys, key, value);
+}
+
+/* Move records of previous leaf to last leaf,
+ * so that last leaf is not nearly empty.
+ */
+static void balance_leaves(bulk_state * s) {
+	leaf_record temp[MAX_LEAF_ORDER];
+	int i, num, move;
+
+	num = s->prev->num_keys + s->cur->num_keys;
+	move = s->prev->num_keys - (num + 1) / 2;
+	if (move <= 0)
+		return;
+	for (i = 0; i < move; i++)
+		get_leaf_record(s->prev, s->prev->num_keys - move + i, &temp[i]);
+	for (i = 0; i < s->cur->num_keys; i++)
+		get_leaf_record(s->cur, i, &temp[move + i]);
+	set_leaf_records(s->cur, temp, move + s->cur->num_keys);
+	// Cells of moved records become free.
+	s->prev->num_keys -= move;
+	s->leaves[s->num_leaves - 1].key = s->cur->keys[0];
+}
+
+/* Move leaves of previous bottom page to last bottom page.
+ * Moved leaves which are already written get new parent.
+ */
+static void balance_bottom(bulk_state * s) {
+	int i, num, start;
+	struct iovec iov;
+	int64_t parent;
+
+	if (s->num_bottom < 2)
+		return;
+	num = s->num_leaves - (s->num_bottom - 2) * s->internal_fill;
+	start = (s->num_bottom - 2) * s->internal_fill + (num + 1) / 2;
+	if (start >= s->last_start)
+		return;
+
+	flush_batch(s);
+	parent = s->bottom[s->num_bottom - 1];
+	iov.iov_base = &parent;
+	iov.iov_len = sizeof(int64_t);
+	// Last two leaves are not written yet.
+	for (i = start; i < s->last_start && i < s->num_leaves - 2; i++)
+		if (submit_io(s->table_id, &iov, 1, s->leaves[i].offset, true) != 0)
+			s->result = -1;
+	s->last_start = start;
+}
+
+static void write_internal(bulk_state * s, bulk_child * children, int num,
+		int64_t offset, int64_t parent) {
+	internal_page * page = (internal_page *)s->page;
+	int i;
+
+	memset(page, 0, page_size);
+	page->parent_page = parent;
+	page->is_leaf = 0;
+	page->num_keys = num - 1;
+	page->one_more_page = children[0].offset;
+	for (i = 1; i < num; i++) {
+		page->records[i - 1].key = children[i].key;
+		page->records[i - 1].page_offset = children[i].offset;
+	}
+	write_bulk_page(s, (Page *)page, offset);
+}
+
+/* Build internal pages level by level from bottom pages.
+ * Return offset of root.
+ */
+static int64_t build_internal(bulk_state * s) {
+	bulk_child * children, * upper;
+	int64_t * offsets, * up_offsets;
+	int * start, * up_start;
+	int i, g, num, up;
+	int64_t root;
+
+	// Bottom pages take leaves of their slots.
+	num = s->num_bottom;
+	children = s->leaves;
+	offsets = s->bottom;
+	start = (int *)malloc(sizeof(int) * (num + 1));
+	for (i = 0; i < num; i++)
+		start[i] = i * s->internal_fill;
+	start[num - 1] = s->last_start;
+	start[num] = s->num_leaves;
+
+	// Upper pages are placed freely, so children are spread evenly.
+	while (num > 1) {
+		up = (num + s->internal_fill - 1) / s->internal_fill;
+		upper = (bulk_child *)malloc(sizeof(bulk_child) * num);
+		up_offsets = (int64_t *)malloc(sizeof(int64_t) * up);
+		up_start = (int *)malloc(sizeof(int) * (up + 1));
+		for (g = 0; g < up; g++) {
+			up_start[g] = (int)((int64_t)g * num / up);
+			up_offsets[g] = s->next_offset;
+			s->next_offset += page_size;
+		}
+		up_start[up] = num;
+
+		for (g = 0; g < up; g++) {
+			for (i = up_start[g]; i < up_start[g + 1]; i++) {
+				write_internal(s, &children[start[i]], start[i + 1] - start[i],
+						offsets[i], up_offsets[g]);
+				upper[i].key = children[start[i]].key;
+				upper[i].offset = offsets[i];
+			}
+		}
+
+		if (children != s->leaves)
+			free(children);
+		if (offsets != s->bottom)
+			free(offsets);
+		free(start);
+		children = upper;
+		offsets = up_offsets;
+		start = up_start;
+		num = up;
+	}
+
+	root = offsets[0];
+	write_internal(s, children, start[1], root, 0);
+	if (children != s->leaves)
+		free(children);
+	if (offsets != s->bottom)
+		free(offsets);
+	free(start);
+	return root;
+}
+
+/* Build empty table from records of next in ascending key order.
+ * Leaves are filled up to fill_factor percent. If it is 0,
+ * BULK_FILL_FACTOR is used. Pages are never filled below half.
+ * If success, return 0. Otherwise, return -1 and table stays empty.
+ */
+int bulk_load(int table_id, bulk_iterator next, void * arg, int fill_factor) {
+	bulk_state s;
+	Buf * b;
+	leaf_page * root;
+	struct stat st;
+	int64_t key, end, old_root;
+	char value[VALUE_SIZE];
+	bool empty;
+
+	if (fill_factor == 0)
+		fill_factor = BULK_FILL_FACTOR;
+	if (fill_factor < 0 || fill_factor > 100) {
+		printf("bulk_load() error : fill factor %d is not supported\n", fill_factor);
+		return -1;
+	}
+	if (trx) {
+		printf("bulk_load() error : bulk load is not logged, so it can't run in transaction\n");
+		return -1;
+	}
+
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table[table_id] == 0 || table_map[table_id] != NULL) {
+		printf("bulk_load() error : table %d is not open for write\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+	old_root = descs[table_id].root_page;
+	b = get_buf(table_id, old_root);
+	root = (leaf_page *)b->page;
+	empty = root->is_leaf && root->num_keys == 0;
+	release_pincount(b);
+	if (!empty) {
+		printf("bulk_load() error : table %d is not empty\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+
+	// New pages go after end of file. Pages in buffer pool are written first.
+	flush_dirty_pages(table_id);
+	fstat(table[table_id], &st);
+	end = (st.st_size + page_size - 1) / page_size * page_size;
+
+	memset(&s, 0, sizeof(s));
+	s.table_id = table_id;
+	s.leaf_fill = (leaf_order - 1) * fill_factor / 100;
+	if (s.leaf_fill < cut(leaf_order - 1))
+		s.leaf_fill = cut(leaf_order - 1);
+	s.internal_fill = internal_order * fill_factor / 100;
+	if (s.internal_fill < cut(internal_order - 1))
+		s.internal_fill = cut(internal_order - 1);
+	s.next_offset = end;
+	s.prev = (leaf_page *)malloc(page_size);
+	s.cur = (leaf_page *)malloc(page_size);
+	s.page = (Page *)malloc(page_size);
+	s.batch = (char *)malloc((size_t)BULK_BATCH * page_size);
+
+	while (s.result == 0 && next(arg, &key, value) == 0) {
+		if (s.num_leaves > 0 && key <= s.cur->keys[s.cur->num_keys - 1]) {
+			printf("bulk_load() error : key %" PRId64 " is not in ascending order\n", key);
+			s.result = -1;
+			break;
+		}
+		add_record(&s, key, value);
+	}
+
+	if (s.result == 0 && s.num_leaves > 0) {
+		if (s.num_leaves > 1) {
+			balance_leaves(&s);
+			balance_bottom(&s);
+			write_leaf(&s, s.prev, s.num_leaves - 2);
+		}
+		write_leaf(&s, s.cur, s.num_leaves - 1);
+		key = s.num_leaves > 1 ? build_internal(&s) : s.leaves[0].offset;
+		flush_batch(&s);
+		// Tree is on disk before header page points to it.
+		sync_table(table_id);
+	}
+
+	if (s.result == 0 && s.num_leaves > 0) {
+		// Old root and header page in buffer pool are stale.
+		drop_table_pages(table_id);
+		reset_readahead(table_id);
+		descs[table_id].root_page = key;
+		/* Free page is after new tree. Read-ahead and warm-up read only
+		 * pages before free page, and allocation goes forward from it,
+		 * so old root page is left unused.
+		 */
+		descs[table_id].free_page = s.next_offset;
+		descs[table_id].num_pages = 1 + (s.next_offset - end) / page_size;
+		descs[table_id].dirty = true;
+		if (flush_dirty_pages(table_id) < 0)
+			s.result = -1;
+		sync_table(table_id);
+	} else if (s.result != 0) {
+		ftruncate(table[table_id], st.st_size);
+	}
+	pthread_rwlock_unlock(&table_latch[table_id]);
+
+	free(s.prev);
+	free(s.cur);
+	free(s.page);
+	free(s.batch);
+	free(s.leaves);
+	free(s.bottom);
+	return s.result;
+}
@@ -0,0 +1,231 @@
+/**
+ *		@class Database System
+ *		@file  cursor.c
+ *		@brief Range scan cursor
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+/* Cursor starts at leaf of lower bound and follows leaf chain
+ * until key is greater than upper bound. Reverse cursor starts at
+ * leaf of upper bound and follows left siblings.
+ * Table is read locked from open_cursor to close_cursor like join,
+ * so leaf chain is not changed under cursor. Writers of the table
+ * wait until cursor is closed, so thread with open cursor must not
+ * write to the table.
+ * Leaves are read by ACCESS_SCAN going right, and read-ahead thread
+ * follows chain. Read-ahead only goes right, so leaves going left
+ * are read as random pages.
+ */
+
+// Release leaf and end cursor.
+static void end_cursor(cursor * c) {
+	if (c->b != NULL)
+		release_pincount(c->b);
+	c->b = NULL;
+	c->leaf = NULL;
+	c->done = true;
+}
+
+/* Ask next sibling to be read while leaf is scanned.
+ * If range ends in this leaf, nothing is asked.
+ * Without read-ahead thread, leaf of buffer pool is not prefetched.
+ */
+static void prefetch_sibling(cursor * c) {
+	leaf_page * leaf = c->leaf;
+	int64_t sibling;
+	Page * next;
+
+	sibling = c->reverse ? leaf->left_sibling : leaf->right_sibling;
+	if (!c->prefetch || sibling == 0)
+		return;
+	if (leaf->num_keys > 0 && (c->reverse ? leaf->keys[0] <= c->lower :
+				leaf->keys[leaf->num_keys - 1] >= c->upper))
+		return;
+
+	if (c->b == NULL) {
+		if ((next = map_page(c->table_id, sibling)) != NULL)
+			madvise(next, page_size, MADV_WILLNEED);
+	} else if (__atomic_load_n(&ra_running, __ATOMIC_ACQUIRE))
+		request_readahead(c->table_id, sibling, 1,
+				sibling == c->b->page_offset + page_size);
+}
+
+// Move to next sibling. Leaf is released before sibling is pinned.
+static void next_leaf(cursor * c) {
+	int64_t next = c->reverse ? c->leaf->left_sibling : c->leaf->right_sibling;
+
+	end_cursor(c);
+	if (next == 0)
+		return;
+
+	if (table_map[c->table_id] != NULL) {
+		if ((c->leaf = (leaf_page *)map_page(c->table_id, next)) == NULL)
+			return;
+	} else {
+		c->b = c->reverse ? get_buf(c->table_id, next) : get_buf_scan(c->table_id, next);
+		c->leaf = (leaf_page *)c->b->page;
+	}
+	c->index = c->reverse ? c->leaf->num_keys - 1 : 0;
+	c->done = false;
+	prefetch_sibling(c);
+}
+
+/* Point cursor to next record in range.
+ * Return 0, or -1 if range is done.
+ */
+static int seek_record(cursor * c) {
+	int64_t key;
+
+	while (!c->done) {
+		if (c->index >= 0 && c->index < c->leaf->num_keys) {
+			key = c->leaf->keys[c->index];
+			if (c->reverse ? key >= c->lower : key <= c->upper)
+				return 0;
+			end_cursor(c);
+		} else
+			next_leaf(c);
+	}
+	return -1;
+}
+
+// Open cursor at key. Index is set by caller.
+static int start_cursor(cursor * c, int table_id, int64_t key, int64_t lower,
+		int64_t upper, bool prefetch, bool reverse) {
+	header_page * hp;
+
+	pthread_rwlock_rdlock(&table_latch[table_id]);
+	if (table[table_id] == 0) {
+		printf("open_cursor() error : table %d is not open\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+	// Read write table is linked by open_table, but mapped one is not changed.
+	if (reverse && table_map[table_id] != NULL &&
+			(hp = (header_page *)map_page(table_id, HEADERPAGE_OFFSET))->left_linked == 0) {
+		printf("open_reverse_cursor() error : leaves of table %d have no left sibling\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+
+	c->table_id = table_id;
+	c->b = NULL;
+	c->lower = lower;
+	c->upper = upper;
+	c->reverse = reverse;
+	c->prefetch = prefetch;
+	c->done = false;
+
+	if (table_map[table_id] != NULL) {
+		c->leaf = find_mapped_leaf(table_id, key);
+	} else {
+		c->b = find_leaf(table_id, key);
+		c->leaf = (leaf_page *)c->b->page;
+		// Table has no tree.
+		if (c->b->page_offset == 0)
+			end_cursor(c);
+	}
+	if (c->leaf == NULL || lower > upper)
+		end_cursor(c);
+	return 0;
+}
+
+/* Open cursor at first key >= lower.
+ * Return 0, or -1 if table is not open.
+ */
+int open_cursor(cursor * c, int table_id, int64_t lower, int64_t upper, bool prefetch) {
+	if (start_cursor(c, table_id, lower, lower, upper, prefetch, false) != 0)
+		return -1;
+	if (!c->done) {
+		c->index = search_leaf(c->leaf, lower);
+		prefetch_sibling(c);
+	}
+	return 0;
+}
+
+/* Open cursor at last key <= upper. Records are returned
+ * in descending order until key is less than lower.
+ * Return 0, or -1 if table is not open.
+ */
+int open_reverse_cursor(cursor * c, int table_id, int64_t lower, int64_t upper, bool prefetch) {
+	leaf_page * leaf;
+	int i;
+
+	if (start_cursor(c, table_id, upper, lower, upper, prefetch, true) != 0)
+		return -1;
+	if (!c->done) {
+		leaf = c->leaf;
+		i = search_leaf(leaf, upper);
+		if (i == leaf->num_keys || leaf->keys[i] > upper)
+			i--;
+		c->index = i;
+		prefetch_sibling(c);
+	}
+	return 0;
+}
+
+/* Copy next record to key and value.
+ * Return 0, or -1 if range is done.
+ */
+int cursor_next(cursor * c, int64_t * key, char * value) {
+	if (seek_record(c) != 0)
+		return -1;
+	*key = c->leaf->keys[c->index];
+	memcpy(value, LEAF_VALUE(c->leaf, c->index), VALUE_SIZE);
+	c->index += c->reverse ? -1 : 1;
+	return 0;
+}
+
+/* Copy up to max next records.
+ * Return the number of records, and 0 if range is done.
+ */
+int cursor_next_batch(cursor * c, leaf_record * records, int max) {
+	int n;
+
+	n = 0;
+	while (n < max && seek_record(c) == 0) {
+		get_leaf_record(c->leaf, c->index, &records[n++]);
+		c->index += c->reverse ? -1 : 1;
+	}
+	return n;
+}
+
+// Release leaf and unlock table.
+void close_cursor(cursor * c) {
+	end_cursor(c);
+	pthread_rwlock_unlock(&table_latch[c->table_id]);
+}
+
+/* Set left sibling of every leaf in table made before leaves had it.
+ * Leaf chain is read once, and header page records it is done.
+ * Caller holds write latch of table.
+ */
+void link_leaves(int table_id) {
+	Buf * b, * hb;
+	leaf_page * leaf;
+	int64_t left, next;
+
+	if (descs[table_id].root_page != 0) {
+		leaf = get_first_leafpage(table_id, &b);
+		left = 0;
+		for (;;) {
+			if (leaf->left_sibling != left) {
+				leaf->left_sibling = left;
+				mark_dirty(b);
+			}
+			left = b->page_offset;
+			next = leaf->right_sibling;
+			release_pincount(b);
+			if (next == 0)
+				break;
+			b = get_buf_scan(table_id, next);
+			leaf = (leaf_page *)b->page;
+		}
+	}
+	hb = get_buf(table_id, HEADERPAGE_OFFSET);
+	((header_page *)hb->page)->left_linked = 1;
+	mark_dirty(hb);
+	release_pincount(hb);
+}
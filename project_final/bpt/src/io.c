@@ -0,0 +1,328 @@
+/**
+ *		@class Database System
+ *		@file  io.c
+ *		@brief I/O backends of page reads and writes
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Every page read and write goes to io->submit.
+ * Blocking backend does each request by preadv or pwritev.
+ * io_uring backend puts whole batch into submission queue,
+ * so many requests are in flight from one thread.
+ * Each thread has its own ring, so threads don't wait for each other.
+ */
+
+// Count bytes of completed request.
+static void count_io(io_request * r) {
+	if (r->result <= 0)
+		return;
+	if (r->write)
+		__atomic_add_fetch(&table_bytes_written[r->table_id], r->result, __ATOMIC_RELAXED);
+	else
+		__atomic_add_fetch(&table_bytes_read[r->table_id], r->result, __ATOMIC_RELAXED);
+}
+
+// BLOCKING
+
+static int blocking_init(void) {
+	return 0;
+}
+
+static void blocking_destroy(void) {
+}
+
+static int blocking_submit(io_request * reqs, int num) {
+	int i, result = 0;
+
+	for (i = 0; i < num; i++) {
+		if (reqs[i].write)
+			reqs[i].result = pwritev(table[reqs[i].table_id], reqs[i].iov, reqs[i].num, reqs[i].offset);
+		else
+			reqs[i].result = preadv(table[reqs[i].table_id], reqs[i].iov, reqs[i].num, reqs[i].offset);
+		if (reqs[i].result < 0)
+			result = -1;
+		count_io(&reqs[i]);
+	}
+	return result;
+}
+
+// IO_URING
+
+// Rings shared with kernel.
+typedef struct uring {
+	int fd;
+	unsigned entries;
+	unsigned * sq_head, * sq_tail, * sq_mask, * sq_array;
+	unsigned * cq_head, * cq_tail, * cq_mask;
+	struct io_uring_sqe * sqes;
+	struct io_uring_cqe * cqes;
+	void * sq_ring, * cq_ring;
+	size_t sq_size, cq_size, sqes_size;
+} uring;
+
+static pthread_key_t ring_key;
+
+static void free_ring(void * arg) {
+	uring * r = (uring *)arg;
+
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_size);
+	munmap(r->sq_ring, r->sq_size);
+	close(r->fd);
+	free(r);
+}
+
+// Set up ring of calling thread. If fail, return NULL.
+static uring * alloc_ring(void) {
+	struct io_uring_params params;
+	uring * r;
+	char * sq, * cq;
+
+	r = (uring *)malloc(sizeof(uring));
+	memset(&params, 0, sizeof(params));
+	if ((r->fd = syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params)) < 0) {
+		free(r);
+		return NULL;
+	}
+	r->entries = params.sq_entries;
+
+	r->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	r->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	// Both rings may be one mapping.
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_size > r->sq_size)
+			r->sq_size = r->cq_size;
+		r->cq_size = r->sq_size;
+	}
+	r->sq_ring = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED) {
+		close(r->fd);
+		free(r);
+		return NULL;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ring = r->sq_ring;
+	else
+		r->cq_ring = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+		if (r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring)
+			munmap(r->cq_ring, r->cq_size);
+		munmap(r->sq_ring, r->sq_size);
+		close(r->fd);
+		free(r);
+		return NULL;
+	}
+
+	sq = (char *)r->sq_ring;
+	cq = (char *)r->cq_ring;
+	r->sq_head = (unsigned *)(sq + params.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + params.sq_off.array);
+	r->cq_head = (unsigned *)(cq + params.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	return r;
+}
+
+static int uring_init(void) {
+	uring * r;
+
+	// Check kernel supports io_uring.
+	if ((r = alloc_ring()) == NULL)
+		return -1;
+	pthread_key_create(&ring_key, free_ring);
+	pthread_setspecific(ring_key, r);
+	return 0;
+}
+
+// Ring of other threads is freed when thread exits.
+static void uring_destroy(void) {
+	uring * r = (uring *)pthread_getspecific(ring_key);
+
+	if (r != NULL)
+		free_ring(r);
+	pthread_key_delete(ring_key);
+}
+
+// Request which has not completed in ring.
+#define URING_PENDING	(-EINPROGRESS)
+
+/* Read completions in ring and set results of their requests.
+ * Return the number of completions.
+ */
+static int uring_reap(uring * r, io_request * reqs, int * result) {
+	unsigned head;
+	int n;
+	struct io_uring_cqe * cqe;
+
+	n = 0;
+	head = *r->cq_head;
+	while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &r->cqes[head & *r->cq_mask];
+		reqs[cqe->user_data].result = cqe->res;
+		if (cqe->res < 0)
+			*result = -1;
+		count_io(&reqs[cqe->user_data]);
+		head++;
+		n++;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+/* Ring of thread failed. Wait for requests kernel already took,
+ * so their iovecs are not used after return, and free the ring.
+ * Next submit of thread sets up new ring.
+ * Requests which didn't complete are done by blocking backend.
+ */
+static int uring_fail(uring * r, io_request * reqs, int num, int submitted, int result) {
+	int i, n;
+	io_request * rest;
+
+	while (submitted > 0) {
+		if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+				errno != EINTR && errno != EAGAIN)
+			break;
+		submitted -= uring_reap(r, reqs, &result);
+	}
+	free_ring(r);
+	pthread_setspecific(ring_key, NULL);
+
+	rest = (io_request *)malloc(sizeof(io_request) * num);
+	for (i = 0, n = 0; i < num; i++)
+		if (reqs[i].result == URING_PENDING)
+			rest[n++] = reqs[i];
+	if (blocking_submit(rest, n) != 0)
+		result = -1;
+	for (i = 0, n = 0; i < num; i++)
+		if (reqs[i].result == URING_PENDING)
+			reqs[i].result = rest[n++].result;
+	free(rest);
+	return result;
+}
+
+/* Submit every request and wait until all of them complete.
+ * At most entries requests are in flight at once.
+ */
+static int uring_submit(io_request * reqs, int num) {
+	int i, ret, result, next, done, inflight, to_submit;
+	unsigned tail, idx;
+	struct io_uring_sqe * sqe;
+	uring * r;
+
+	if ((r = (uring *)pthread_getspecific(ring_key)) == NULL) {
+		if ((r = alloc_ring()) == NULL)
+			return blocking_submit(reqs, num);
+		pthread_setspecific(ring_key, r);
+	}
+
+	for (i = 0; i < num; i++)
+		reqs[i].result = URING_PENDING;
+	result = 0;
+	next = done = inflight = to_submit = 0;
+	while (done < num) {
+		// Fill submission queue.
+		tail = *r->sq_tail;
+		while (next < num && inflight < (int)r->entries) {
+			idx = tail & *r->sq_mask;
+			sqe = &r->sqes[idx];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = reqs[next].write ? IORING_OP_WRITEV : IORING_OP_READV;
+			sqe->fd = table[reqs[next].table_id];
+			sqe->addr = (uint64_t)(uintptr_t)reqs[next].iov;
+			sqe->len = reqs[next].num;
+			sqe->off = reqs[next].offset;
+			sqe->user_data = next;
+			r->sq_array[idx] = idx;
+			tail++;
+			next++;
+			inflight++;
+			to_submit++;
+		}
+		__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+		ret = syscall(__NR_io_uring_enter, r->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			printf("io_uring_enter() error : %s\n", strerror(errno));
+			return uring_fail(r, reqs, num, inflight - to_submit, result);
+		}
+		to_submit -= ret;
+
+		// Reap completions.
+		ret = uring_reap(r, reqs, &result);
+		done += ret;
+		inflight -= ret;
+	}
+	return result;
+}
+
+static io_backend blocking_backend = {
+	blocking_init, blocking_destroy, blocking_submit
+};
+
+static io_backend uring_backend = {
+	uring_init, uring_destroy, uring_submit
+};
+
+io_backend * get_io_backend(IO_TYPE type) {
+	switch (type) {
+	case IO_URING:
+		return &uring_backend;
+	default:
+		return &blocking_backend;
+	}
+}
+
+/* Start I/O backend of config.
+ * If io_uring can't be used, blocking backend is used.
+ */
+void init_io(void) {
+	io = get_io_backend(config.io_backend);
+	if (io->init() != 0) {
+		printf("fail to start io_uring, use blocking I/O\n");
+		io = &blocking_backend;
+	}
+}
+
+void destroy_io(void) {
+	io->destroy();
+	io = &blocking_backend;
+}
+
+/* Submit one read or write of contiguous pages.
+ * If every byte is read or written, return 0. Otherwise, return -1.
+ */
+int submit_io(int table_id, struct iovec * iov, int num, int64_t offset, bool write) {
+	io_request req;
+	ssize_t size;
+	int i;
+
+	req.table_id = table_id;
+	req.iov = iov;
+	req.num = num;
+	req.offset = offset;
+	req.write = write;
+	if (io == NULL)
+		io = &blocking_backend;
+	if (io->submit(&req, 1) != 0)
+		return -1;
+	for (i = 0, size = 0; i < num; i++)
+		size += iov[i].iov_len;
+	return req.result == size ? 0 : -1;
+}
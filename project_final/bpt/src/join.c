@@ -8,15 +8,22 @@
 #include "bpt.h"
 
 // Find first leaf page.
-Buf * get_first_leafpage(int table_id) {
+// Leaf of mapped table is not pinned, and *lb is NULL.
+leaf_page * get_first_leafpage(int table_id, Buf ** lb) {
 	header_page * hp;
-	Buf * hb, * b;
+	Buf * b;
 	internal_page * c;
 
-	hb = get_buf(table_id, HEADERPAGE_OFFSET);
-	hp = (header_page *) hb->page;
+	if (table_map[table_id] != NULL) {
+		*lb = NULL;
+		hp = (header_page *)map_page(table_id, HEADERPAGE_OFFSET);
+		c = (internal_page *)map_page(table_id, hp->root_page);
+		while (!c->is_leaf)
+			c = (internal_page *)map_page(table_id, c->one_more_page);
+		return (leaf_page *)c;
+	}
 
-	b = get_buf(table_id, hp->root_page);
+	b = get_buf(table_id, descs[table_id].root_page);
 	c = (internal_page *) b->page;
 
 	while (!c->is_leaf) {
@@ -24,28 +31,50 @@ Buf * get_first_leafpage(int table_id) {
 		b = get_buf(table_id, c->one_more_page);
 		c = (internal_page *) b->page;
 	}
-	release_pincount(hb);
-	return b;
+	*lb = b;
+	return (leaf_page *)c;
+}
+
+/* Get next leaf page of leaf chain.
+ * Leaf of mapped table is read from mapping, and kernel is asked
+ * to read its right sibling ahead.
+ */
+static leaf_page * get_next_leafpage(int table_id, int64_t offset, Buf ** b) {
+	leaf_page * leaf;
+	Page * next;
+
+	if (table_map[table_id] != NULL) {
+		*b = NULL;
+		leaf = (leaf_page *)map_page(table_id, offset);
+		if (leaf->right_sibling != 0 &&
+				(next = map_page(table_id, leaf->right_sibling)) != NULL)
+			madvise(next, page_size, MADV_WILLNEED);
+		return leaf;
+	}
+	*b = get_buf_scan(table_id, offset);
+	return (leaf_page *)(*b)->page;
+}
+
+// Release leaf page. Leaf of mapped table has no pin.
+static void release_leafpage(Buf * b) {
+	if (b != NULL)
+		release_pincount(b);
 }
 
 // Make output buffer.
 // I use 1 buffer page to write result.
 Buf * make_outbuffer() {
 	int i;
-	for (i = 0; i < num_buf; i++) {
-		if (buf[i].pin_count == 0) {
-			if (buf[i].is_dirty) {
-				write_page(buf[i].table_id, buf[i].page, PAGE_SIZE, buf[i].page_offset);
-				buf[i].page_offset = OUTPUT_OFFSET;
-				buf[i].table_id = OUTPUT_BUFFER;
-			}
-			break;
-		}
-	}
-	if (update_LRU(&buf[i]) != 0) {
-		printf("make_outbuffer() error!!\n");
-		return NULL;
-	}
+	buf_partition * p;
+
+	p = get_partition(OUTPUT_BUFFER, OUTPUT_OFFSET);
+	pthread_mutex_lock(&p->latch);
+	i = get_free_buffer_index(p, OUTPUT_BUFFER);
+	buf[i].is_dirty = false;
+	buf[i].page_offset = OUTPUT_OFFSET;
+	buf[i].table_id = OUTPUT_BUFFER;
+	touch_buf(&buf[i], ACCESS_SCAN);
+	pthread_mutex_unlock(&p->latch);
 	return &buf[i];
 }
 
@@ -54,15 +83,15 @@ Buf * make_outbuffer() {
 // Check result page full.
 int push_resultpage(FILE * fp, result_page * rp, leaf_page * l1, leaf_page * l2, int num_key_1, int num_key_2, int num_result) {
 
-	if (num_result == JOIN_RESULT_SIZE) {
+	if (num_result == join_result_size) {
 		flush_resultpage(fp, rp, num_result);
 		num_result = 0;
 	}
 
-	rp->value[num_result].key1 = l1->records[num_key_1].key;
-	memcpy(rp->value[num_result].value1, l1->records[num_key_1].value, VALUE_SIZE);
-	rp->value[num_result].key2 = l2->records[num_key_2].key;
-	memcpy(rp->value[num_result].value2, l2->records[num_key_2].value, VALUE_SIZE);
+	rp->value[num_result].key1 = l1->keys[num_key_1];
+	memcpy(rp->value[num_result].value1, LEAF_VALUE(l1, num_key_1), VALUE_SIZE);
+	rp->value[num_result].key2 = l2->keys[num_key_2];
+	memcpy(rp->value[num_result].value2, LEAF_VALUE(l2, num_key_2), VALUE_SIZE);
 
 	return ++num_result;
 }
@@ -78,27 +107,44 @@ void flush_resultpage(FILE * fp, result_page * rp, int num_result) {
 		}
 }
 
+static int merge_join(int table_id_1, int table_id_2, char * pathname);
+
 // Do natural join with given two tables and 
 // write result table to the file using given pathname. 
 // Return 0 if success, otherwise return non-zero value.
 // Two tables should have been opened earlier.
 int join_table(int table_id_1, int table_id_2, char * pathname) {
+	int result;
+
+	// Trees are not changed while they are joined.
+	pthread_rwlock_rdlock(&table_latch[table_id_1]);
+	if (table_id_2 != table_id_1)
+		pthread_rwlock_rdlock(&table_latch[table_id_2]);
+
+	result = merge_join(table_id_1, table_id_2, pathname);
+
+	if (table_id_2 != table_id_1)
+		pthread_rwlock_unlock(&table_latch[table_id_2]);
+	pthread_rwlock_unlock(&table_latch[table_id_1]);
+	return result;
+}
+
+// Merge join on leaf chains of two tables.
+static int merge_join(int table_id_1, int table_id_2, char * pathname) {
 	
 	leaf_page * leaf_1, * leaf_2;
 	result_page * result;
 	Buf * leaf_buf_1, * leaf_buf_2, * out_buf;
 	int num_key_1, num_key_2, mark, num_result;
 	int num_end1, num_end2;
+	int64_t next;
 	FILE * fp;
 
 	fp = fopen(pathname, "w");
 
 	// First leaf page of each file.
-	leaf_buf_1 = get_first_leafpage(table_id_1);
-	leaf_buf_2 = get_first_leafpage(table_id_2);
-
-	leaf_1 = (leaf_page *) leaf_buf_1->page;
-	leaf_2 = (leaf_page *) leaf_buf_2->page;
+	leaf_1 = get_first_leafpage(table_id_1, &leaf_buf_1);
+	leaf_2 = get_first_leafpage(table_id_2, &leaf_buf_2);
 
 	// Set output buffer and result page.
 	out_buf = make_outbuffer(); 
@@ -112,31 +158,36 @@ int join_table(int table_id_1, int table_id_2, char * pathname) {
 
 	// Compare key between table_id_1 and table_id_2.
 	while (1) {
-		while (leaf_1->records[num_key_1].key < leaf_2->records[num_key_2].key 
-				&& num_key_1 < num_end1) 
+		// Bound is checked first, so record after the last is never read.
+		while (num_key_1 < num_end1 && num_key_2 < num_end2
+				&& leaf_1->keys[num_key_1] < leaf_2->keys[num_key_2]) 
 			num_key_1++;
 		if (num_key_1 < num_end1) {
-			while (leaf_1->records[num_key_1].key > leaf_2->records[num_key_2].key 
-					&& num_key_2 < num_end2)
+			while (num_key_2 < num_end2
+					&& leaf_1->keys[num_key_1] > leaf_2->keys[num_key_2])
 				num_key_2++;
 		}
 	
 		// Assert key1 == key2 or end of leaf page.
 		// If search end of leaf page, read next leaf page.
 		if (num_key_1 >= num_end1) {
-			release_pincount(leaf_buf_1);
+			// Page may be evicted after it is released.
+			next = leaf_1->right_sibling;
+			release_leafpage(leaf_buf_1);
 
 			// If current leaf page is end of file,
 			// Flush result page,
 			// Return 0.
-			if (leaf_1->right_sibling == 0) {
+			if (next == 0) {
 				flush_resultpage(fp, result, num_result);
+				release_leafpage(leaf_buf_2);
+				release_pincount(out_buf);
+				fclose(fp);
 				return 0;
 			} 
 
 			// Go to next leaf page.
-			leaf_buf_1 = get_buf(table_id_1, leaf_1->right_sibling);
-			leaf_1 = (leaf_page *) leaf_buf_1->page;
+			leaf_1 = get_next_leafpage(table_id_1, next, &leaf_buf_1);
 
 			num_key_1 = 0;
 			num_end1 = leaf_1->num_keys;
@@ -144,19 +195,23 @@ int join_table(int table_id_1, int table_id_2, char * pathname) {
 
 		// If search end of leaf page, read next leaf page.
 		if (num_key_2 >= num_end2) {
-			release_pincount(leaf_buf_2);
+			// Page may be evicted after it is released.
+			next = leaf_2->right_sibling;
+			release_leafpage(leaf_buf_2);
 
 			// If current leaf page is end of file,
 			// Flush result page,
 			// Return 0.
-			if (leaf_2->right_sibling == 0) {
+			if (next == 0) {
 				flush_resultpage(fp, result, num_result);
+				release_leafpage(leaf_buf_1);
+				release_pincount(out_buf);
+				fclose(fp);
 				return 0;
 			} 
 
 			// Go to next leaf page.
-			leaf_buf_2 = get_buf(table_id_2, leaf_2->right_sibling);
-			leaf_2 = (leaf_page *) leaf_buf_2->page;
+			leaf_2 = get_next_leafpage(table_id_2, next, &leaf_buf_2);
 
 			num_key_2 = 0;
 			num_end2 = leaf_2->num_keys;
@@ -165,9 +220,11 @@ int join_table(int table_id_1, int table_id_2, char * pathname) {
 		// Save start of "block"
 		mark = num_key_2;
 
-		while (leaf_1->records[num_key_1].key == leaf_2->records[num_key_2].key && num_key_1 < num_end1) {
+		while (num_key_1 < num_end1 && num_key_2 < num_end2
+				&& leaf_1->keys[num_key_1] == leaf_2->keys[num_key_2]) {
 			// Outer loop over file 1.
-			while (leaf_1->records[num_key_1].key == leaf_2->records[num_key_2].key && num_key_2 < num_end2) {
+			while (num_key_2 < num_end2
+					&& leaf_1->keys[num_key_1] == leaf_2->keys[num_key_2]) {
 				// Inner loop over file 2.
 				num_result = push_resultpage(fp, result, leaf_1, leaf_2, num_key_1, num_key_2, num_result); 
 				num_key_2++;
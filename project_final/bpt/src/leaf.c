@@ -0,0 +1,128 @@
+/**
+ *		@class Database System
+ *		@file  leaf.c
+ *		@brief Leaf page whose keys and values are split
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+// Make empty leaf. Value cells are in order.
+void init_leaf(leaf_page * leaf) {
+	leaf->is_leaf = 1;
+	set_leaf_records(leaf, NULL, 0);
+}
+
+/* Insert key and value as i-th record.
+ * First free cell takes value, and only keys and slots are moved.
+ */
+void insert_into_leaf_at(leaf_page * leaf, int i, int64_t key, char * value) {
+	uint8_t * slots = LEAF_SLOTS(leaf);
+	uint8_t cell = slots[leaf->num_keys];
+	int num = leaf->num_keys - i;
+
+	memmove(&leaf->keys[i + 1], &leaf->keys[i], sizeof(int64_t) * num);
+	memmove(&slots[i + 1], &slots[i], num);
+	leaf->keys[i] = key;
+	slots[i] = cell;
+	memcpy(LEAF_VALUE(leaf, i), value, VALUE_SIZE);
+	leaf->num_keys++;
+}
+
+// Remove i-th record. Its cell becomes free.
+void remove_from_leaf_at(leaf_page * leaf, int i) {
+	uint8_t * slots = LEAF_SLOTS(leaf);
+	uint8_t cell = slots[i];
+	int num = leaf->num_keys - i - 1;
+
+	memmove(&leaf->keys[i], &leaf->keys[i + 1], sizeof(int64_t) * num);
+	memmove(&slots[i], &slots[i + 1], num);
+	leaf->num_keys--;
+	slots[leaf->num_keys] = cell;
+}
+
+void get_leaf_record(leaf_page * leaf, int i, leaf_record * record) {
+	record->key = leaf->keys[i];
+	memcpy(record->value, LEAF_VALUE(leaf, i), VALUE_SIZE);
+}
+
+/* Replace records of leaf with sorted records.
+ * Records must not be in leaf.
+ */
+void set_leaf_records(leaf_page * leaf, leaf_record * records, int num) {
+	uint8_t * slots = LEAF_SLOTS(leaf);
+	char * values = (char *)leaf + leaf_value_offset;
+	int i;
+
+	leaf->format = LEAF_SPLIT;
+	for (i = 0; i < leaf_order - 1; i++)
+		slots[i] = i;
+	for (i = 0; i < num; i++) {
+		leaf->keys[i] = records[i].key;
+		memcpy(values + i * VALUE_SIZE, records[i].value, VALUE_SIZE);
+	}
+	leaf->num_keys = num;
+}
+
+/* Convert leaf made before keys and values were split.
+ * Large page holds fewer records than before, so records
+ * which don't fit are put to overflow.
+ * Return the number of them.
+ */
+static int convert_leaf(leaf_page * leaf, leaf_record * overflow) {
+	leaf_record old[MAX_LEAF_ORDER];
+	int num, n;
+
+	num = leaf->num_keys;
+	memcpy(old, (char *)leaf + PAGE_HEADER, sizeof(leaf_record) * num);
+	n = num < leaf_order - 1 ? num : leaf_order - 1;
+	set_leaf_records(leaf, old, n);
+	memcpy(overflow, &old[n], sizeof(leaf_record) * (num - n));
+	return num - n;
+}
+
+/* Convert every leaf of table made before leaves were LEAF_SPLIT.
+ * Leaf is converted only if its format is old, so table whose
+ * conversion was cut off is converted again safely.
+ * Records which don't fit are inserted after leaf chain is read.
+ * Caller holds write latch of table.
+ */
+void convert_leaves(int table_id) {
+	Buf * b, * hb;
+	leaf_page * leaf;
+	leaf_record * overflow;
+	int i, num, max;
+	int64_t next;
+
+	num = 0;
+	max = MAX_LEAF_ORDER;
+	overflow = (leaf_record *)malloc(sizeof(leaf_record) * max);
+	if (descs[table_id].root_page != 0) {
+		leaf = get_first_leafpage(table_id, &b);
+		for (;;) {
+			if (leaf->format != LEAF_SPLIT) {
+				if (num + MAX_LEAF_ORDER > max) {
+					max *= 2;
+					overflow = (leaf_record *)realloc(overflow, sizeof(leaf_record) * max);
+				}
+				num += convert_leaf(leaf, &overflow[num]);
+				mark_dirty(b);
+			}
+			next = leaf->right_sibling;
+			release_pincount(b);
+			if (next == 0)
+				break;
+			b = get_buf_scan(table_id, next);
+			leaf = (leaf_page *)b->page;
+		}
+	}
+	for (i = 0; i < num; i++)
+		put_record(table_id, overflow[i].key, overflow[i].value, false);
+	free(overflow);
+
+	hb = get_buf(table_id, HEADERPAGE_OFFSET);
+	((header_page *)hb->page)->leaf_format = LEAF_SPLIT;
+	mark_dirty(hb);
+	release_pincount(hb);
+}
@@ -14,18 +14,23 @@ void create_log_buf() {
 	log_buf = (Log *) malloc(sizeof(Log) * LOG_BUFFER_SIZE);
 	for (i = 0; i < LOG_BUFFER_SIZE; i++) {
 		log_buf[i].header = (log_header *)malloc(sizeof(log_header));
-		log_buf[i].old_image = (Page *)malloc(sizeof(Page));
-		log_buf[i].new_image = (Page *)malloc(sizeof(Page));
+		log_buf[i].old_image = (Page *)malloc(page_size);
+		log_buf[i].new_image = (Page *)malloc(page_size);
 	}
 	flushed_num = LOG_INIT_NUM;
 	end_num = LOG_INIT_NUM;
 }
 
-// Create Log record
+/* Create Log record
+ * Log latch is held until complete_log,
+ * so record is not interleaved with record of other thread.
+ */
 int create_log(Buf * b, LOG_TYPE type) {
 	int cur;
 	Log * log;
 
+	pthread_mutex_lock(&log_latch);
+
 	// current index
 	cur = end_num + 1;
 	if (cur == LOG_BUFFER_SIZE)
@@ -38,19 +43,20 @@ int create_log(Buf * b, LOG_TYPE type) {
 		log->header->lsn = 0;
 		log->header->prev_lsn = 0;
 	} else {
-		log->header->lsn = log_buf[end_num].header->lsn + LOG_SIZE;
+		log->header->lsn = log_buf[end_num].header->lsn + log_size;
 		log->header->prev_lsn = log_buf[end_num].header->lsn;
 	}
 
 	log->header->trx_id = trx_id;
 	log->header->type = type;
+	// Every record has images of page size, and recovery checks it.
+	log->header->offset = 0;
+	log->header->length = page_size;
 
 	if (type == UPDATE) {
 		log->header->table_id = b->table_id;
-		log->header->page_num = (b->page_offset) / PAGE_SIZE;
-		log->header->offset = 0;
-		log->header->length = PAGE_SIZE;
-		memcpy(log->old_image, b->page, PAGE_SIZE);
+		log->header->page_num = (b->page_offset) / page_size;
+		memcpy(log->old_image, b->page, page_size);
 	}
 
 	// BEGIN, COMMIT, ABORT are returned right away.
@@ -69,12 +75,13 @@ int complete_log(Buf * b, LOG_TYPE type) {
 	Log * log = &log_buf[cur];
 
 	if (type == UPDATE)
-		memcpy(log->new_image, b->page, PAGE_SIZE); 
+		memcpy(log->new_image, b->page, page_size); 
 
 	if (end_num == LOG_BUFFER_SIZE - 1)
 		flush_log(end_num);
 
 	end_num = cur;
+	pthread_mutex_unlock(&log_latch);
 	return 0;
 }
 
@@ -83,46 +90,83 @@ int complete_log(Buf * b, LOG_TYPE type) {
 void flush_log(int num) {
 	//printf("flush_log %d \n", num);
 	int i;
+	pthread_mutex_lock(&log_latch);
 	for (i = flushed_num + 1; i <= num; i++) {
 		//printf("%d!!!\n", i);
 		write(log_fd, log_buf[i].header, LOG_HEADER_SIZE);
-		write(log_fd, log_buf[i].old_image, PAGE_SIZE);
-		write(log_fd, log_buf[i].new_image, PAGE_SIZE);
+		write(log_fd, log_buf[i].old_image, page_size);
+		write(log_fd, log_buf[i].new_image, page_size);
 	}
+	// In WAL mode, log is not written with O_SYNC.
+	if (config.durability == DURABILITY_WAL && num > flushed_num)
+		fdatasync(log_fd);
+
+	// Page cleaner reads flushed_lsn in other thread.
+	if (num > flushed_num)
+		__atomic_store_n(&flushed_lsn, log_buf[num].header->lsn, __ATOMIC_RELEASE);
 
 	flushed_num = num;
 	if (num == LOG_BUFFER_SIZE - 1)
 		flushed_num = LOG_INIT_NUM;
+	pthread_mutex_unlock(&log_latch);
 }
 
-// Initialize log buffer and
-// check recovery.
-void init_log() {
+/* Initialize log buffer and
+ * check recovery.
+ * If log can't be opened or recovered, return -1. Otherwise, return 0.
+ */
+int init_log() {
 	char * pathname = "minidb.log";
 
 	create_log_buf();
 	
 	// If log file exists
 	if (access(pathname, 0) == 0) {
-		if ((log_fd = open(pathname, O_RDWR | O_SYNC, 0644)) == -1) {
+		if ((log_fd = open(pathname, O_RDWR | sync_flags(), 0644)) == -1) {
 			// fail to access
 			printf("fail to access log file\n");
-			return;
-		} else {
-			recovery_from_file();
+			return -1;
+		} else if (recovery_from_file() != 0) {
+			// Log is kept, new records would overwrite it.
+			close(log_fd);
+			log_fd = -1;
+			return -1;
 		}
 	 } else {
 		 // If log file doesn't exist, make file.
-		 if ((log_fd = open(pathname, O_CREAT | O_RDWR | O_SYNC, 0644)) == -1) {
+		 if ((log_fd = open(pathname, O_CREAT | O_RDWR | sync_flags(), 0644)) == -1) {
 			// fail to make file.
 			printf("faile to make log file\n");
-			return;
+			return -1;
 		 }
 	 }
+	return 0;
 }
 
-// Recovery from log file.
-void recovery_from_file() {
+/* Check every update record of log was written with page size of database.
+ * Records are found by page size, so log of other page size
+ * can't be parsed. Only update records have length.
+ * If log can be recovered, return 0. Otherwise, return -1.
+ */
+static int check_log(void) {
+	log_header log;
+	int64_t log_offset;
+
+	log_offset = 0;
+	while (pread(log_fd, &log, LOG_HEADER_SIZE, log_offset) > 0) {
+		if (log.type == UPDATE && log.length != page_size) {
+			printf("recovery_from_file() error : log is not written with page size %d\n", page_size);
+			return -1;
+		}
+		log_offset += log_size;
+	}
+	return 0;
+}
+
+/* Recovery from log file.
+ * If log can't be recovered, return -1. Otherwise, return 0.
+ */
+int recovery_from_file() {
 	char * name_table[11] = {
 		"DATA0",
 		"DATA1",
@@ -143,12 +187,17 @@ void recovery_from_file() {
 	log_header *log;
 	int64_t log_offset;
 	Page * old_page, * new_page;
+	int i;
+
+	if (check_log() != 0)
+		return -1;
+	recovering = true;
 
 	flushed_lsn = 0;
 	log_offset = 0;
 	is_trx = false;
 	log = (log_header *)malloc(sizeof(log_header));
-	new_page = (Page *)malloc(sizeof(Page));
+	new_page = (Page *)malloc(page_size);
 
 	// redo phase	
 	while (pread(log_fd, log, LOG_HEADER_SIZE, log_offset) > 0) {
@@ -159,11 +208,11 @@ void recovery_from_file() {
 			case UPDATE : 
 				if (table[log->table_id] == 0) 
 					open_table(name_table[log->table_id]);
-				log_offset += (LOG_HEADER_SIZE + PAGE_SIZE);
-				pread(log_fd, new_page, PAGE_SIZE, log_offset);
-				log_offset += PAGE_SIZE;
-				b = get_buf(log->table_id, (log->page_num * PAGE_SIZE));
-				memcpy(b->page, new_page, PAGE_SIZE);
+				log_offset += (LOG_HEADER_SIZE + page_size);
+				pread(log_fd, new_page, page_size, log_offset);
+				log_offset += page_size;
+				b = get_buf(log->table_id, (log->page_num * page_size));
+				memcpy(b->page, new_page, page_size);
 				mark_dirty(b);
 				release_pincount(b);
 				break;
@@ -177,7 +226,7 @@ void recovery_from_file() {
 				break;
 		}
 		if (log->type != UPDATE)
-			log_offset += LOG_SIZE;
+			log_offset += log_size;
 	} 
 
 	// uncommited trx exists
@@ -185,7 +234,19 @@ void recovery_from_file() {
 		rollback(log->lsn);
 	free(log);
 		free(new_page);
-
+	recovering = false;
+
+	// Leaves of redo and rollback may have old left sibling or old format,
+	// even if header says linked and split.
+	for (i = 0; i < 11; i++) {
+		if (table[i] == 0 || table_map[i] != NULL)
+			continue;
+		pthread_rwlock_wrlock(&table_latch[i]);
+		convert_leaves(i);
+		link_leaves(i);
+		pthread_rwlock_unlock(&table_latch[i]);
+	}
+	return 0;
 }
 
 void rollback(int64_t lsn) {
@@ -195,7 +256,7 @@ void rollback(int64_t lsn) {
 	Page * old_page;
 
 	log = (log_header *)malloc(sizeof(log_header));
-	old_page = (Page *)malloc(sizeof(Page));
+	old_page = (Page *)malloc(page_size);
 
 	while (pread(log_fd, log, LOG_HEADER_SIZE, lsn) > 0) {
 		if (log->type == BEGIN || log->type == COMMIT) {
@@ -204,7 +265,7 @@ void rollback(int64_t lsn) {
 			break;
 		}
 		if (log->type == UPDATE) {
-			b = get_buf(log->table_id, (log->page_num) * PAGE_SIZE);
+			b = get_buf(log->table_id, (log->page_num) * page_size);
 			create_undo(b, log);
 			mark_dirty(b);
 			release_pincount(b);
@@ -218,33 +279,45 @@ void rollback(int64_t lsn) {
 int update(int table_id, int64_t key, char * value) {
 
 	Buf * b;
-	leaf_page * leaf;
-	int i;
+	int i, result;
 
-	if (find(table_id, key) == NULL) {
+	pthread_rwlock_wrlock(&table_latch[table_id]);
+	if (table_map[table_id] != NULL) {
+		printf("update() error : table %d is read only\n", table_id);
+		pthread_rwlock_unlock(&table_latch[table_id]);
 		return -1;
 	}
 
+	// Key is checked in the leaf, so tree is descended once.
 	b = find_leaf(table_id, key);
-	leaf = (leaf_page *)b->page;
+	if ((i = find_in_leaf((leaf_page *)b->page, key)) < 0) {
+		release_pincount(b);
+		pthread_rwlock_unlock(&table_latch[table_id]);
+		return -1;
+	}
+	result = update_record(b, i, value);
+	pthread_rwlock_unlock(&table_latch[table_id]);
+
+	return result;
+}
+
+/* Overwrite value of record i in leaf of b.
+ * It is logged in transaction. b is released.
+ */
+int update_record(Buf * b, int i, char * value) {
+	leaf_page * leaf = (leaf_page *)b->page;
 
 	if (trx)
 		leaf->page_lsn = create_log(b, UPDATE);
 
-	for (i = 0; i < leaf->num_keys; i++) {
-		if (leaf->records[i].key == key)
-			break;
-	}
-
-	memcpy(leaf->records[i].value, value, VALUE_SIZE);
+	memcpy(LEAF_VALUE(leaf, i), value, VALUE_SIZE);
 
 	if(trx)
 		complete_log(b, UPDATE);
 
 	mark_dirty(b);
 	release_pincount(b);
-
-	return 0;	
+	return 0;
 }
 
 int begin_transaction() {
@@ -284,16 +357,17 @@ int create_undo(Buf * b, log_header * redo) {
 	Log * log;
 	Page * old_page, * new_page;
 
-	old_page = (Page *)malloc(sizeof(Page));
-	new_page = (Page *)malloc(sizeof(Page));
+	old_page = (Page *)malloc(page_size);
+	new_page = (Page *)malloc(page_size);
 
+	pthread_mutex_lock(&log_latch);
 	// current index
 	cur = end_num + 1;
 	if (cur == LOG_BUFFER_SIZE)
 		cur = 0;
 	log = &log_buf[cur];
 
-	log->header->lsn = redo->lsn + LOG_SIZE;
+	log->header->lsn = redo->lsn + log_size;
 	log->header->prev_lsn = redo->lsn;
 
 	log->header->trx_id = trx_id;
@@ -301,22 +375,23 @@ int create_undo(Buf * b, log_header * redo) {
 	log->header->table_id = redo->table_id;
 	log->header->page_num = redo->page_num;
 	log->header->offset = 0;
-	log->header->length = PAGE_SIZE;
+	log->header->length = page_size;
 
-	pread(log_fd, old_page, PAGE_SIZE, redo->lsn + LOG_HEADER_SIZE);
-	pread(log_fd, new_page, PAGE_SIZE, redo->lsn + LOG_HEADER_SIZE + PAGE_SIZE);
+	pread(log_fd, old_page, page_size, redo->lsn + LOG_HEADER_SIZE);
+	pread(log_fd, new_page, page_size, redo->lsn + LOG_HEADER_SIZE + page_size);
 
 	// undo log setting
-	memcpy(log->old_image, new_page, PAGE_SIZE);
-	memcpy(log->new_image, old_page, PAGE_SIZE);
+	memcpy(log->old_image, new_page, page_size);
+	memcpy(log->new_image, old_page, page_size);
 
 	// b page change
-	memcpy(b->page, log->new_image, PAGE_SIZE);
+	memcpy(b->page, log->new_image, page_size);
 	
 	if (end_num == LOG_BUFFER_SIZE - 1)
 		flush_log(end_num);
 
 	end_num = cur;
+	pthread_mutex_unlock(&log_latch);
 	free(old_page);
 	free(new_page);
 	return 0;
@@ -3,7 +3,8 @@ int main(void) {
 
   int table_id;
   int size;
-  int64_t input;
+  int64_t input, upper;
+  cursor cur;
   char instruction;
   char buf[120];
   char path[120];
@@ -37,6 +38,11 @@ int main(void) {
           update(table_id, input, buf);
           break;
 
+        case 'p':
+          scanf("%d %ld %s", &table_id, &input, buf);
+          upsert(table_id, input, buf);
+          break;
+
         case 'f':
           scanf("%d %ld", &table_id, &input);
           char * ftest;
@@ -51,9 +57,41 @@ int main(void) {
           }
           break;
 
+        case 'g':
+          scanf("%d %ld %ld", &table_id, &input, &upper);
+          if (open_cursor(&cur, table_id, input, upper, true) == 0) {
+            while (cursor_next(&cur, &input, buf) == 0)
+              printf("Key: %ld, Value: %s\n", input, buf);
+            close_cursor(&cur);
+            fflush(stdout);
+          }
+          break;
+
+        case 'v':
+          scanf("%d %ld %ld", &table_id, &input, &upper);
+          if (open_reverse_cursor(&cur, table_id, input, upper, true) == 0) {
+            while (cursor_next(&cur, &input, buf) == 0)
+              printf("Key: %ld, Value: %s\n", input, buf);
+            close_cursor(&cur);
+            fflush(stdout);
+          }
+          break;
+
         case 'n':
           scanf("%d", &size);
-          init_db(size);
+          resize_buffer_pool(size);
+          break;
+
+        case 'k':
+          checkpoint();
+          break;
+
+        case 's':
+          print_db_stats();
+          break;
+
+        case 'r':
+          reset_db_stats();
           break;
 
         case 'o':
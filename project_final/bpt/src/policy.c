@@ -0,0 +1,450 @@
+/**
+ *		@class Database System
+ *		@file  policy.c
+ *		@brief Replacement policies of buffer pool
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+/* Each partition has its own replacement state.
+ * Frames of partition are p->frames, so CLOCK hands index p->frames.
+ * Caller holds p->latch. Pin count is changed without latch
+ * by release_pincount, so it is read atomically.
+ */
+#define is_pinned(b)	(__atomic_load_n(&(b)->pin_count, __ATOMIC_ACQUIRE) != 0)
+#define frame_at(p, i)	(&buf[(p)->frames[(i)]])
+
+// LRU
+
+// Link LRU structure of page to head of LRU_list.
+static void lru_push_head(LRU_LIST * list, LRU * lru) {
+	lru->next = list->head->next;
+	list->head->next->prev = lru;
+	lru->prev = list->head;
+	list->head->next = lru;
+}
+
+// Link LRU structure of page to tail of LRU_list.
+static void lru_push_tail(LRU_LIST * list, LRU * lru) {
+	lru->prev = list->tail->prev;
+	list->tail->prev->next = lru;
+	lru->next = list->tail;
+	list->tail->prev = lru;
+}
+
+static void lru_unlink(LRU * lru) {
+	lru->prev->next = lru->next;
+	lru->next->prev = lru->prev;
+}
+
+// Initialize LRU_list of partition.
+static void lru_init(buf_partition * p) {
+	LRU_LIST * list = (LRU_LIST *)malloc(sizeof(LRU_LIST));
+	LRU * dummy_head = (LRU *)malloc(sizeof(LRU));
+	LRU * dummy_tail = (LRU *)malloc(sizeof(LRU));
+	dummy_head->next = dummy_tail;
+	dummy_tail->prev = dummy_head;
+	list->head = dummy_head;
+	list->tail = dummy_tail;
+	list->num_lru = 0;
+	p->lru_list = list;
+}
+
+static void lru_destroy(buf_partition * p) {
+	free(p->lru_list->head);
+	free(p->lru_list->tail);
+	free(p->lru_list);
+	p->lru_list = NULL;
+}
+
+/* When reading the page, LRU structure of page is located head of LRU_list.
+ * Page read by scan is located tail, so it is evicted first.
+ */
+static void lru_admit(buf_partition * p, Buf * b, ACCESS_TYPE type) {
+	b->lru->buf = b;
+	if (type == ACCESS_SCAN)
+		lru_push_tail(p->lru_list, b->lru);
+	else
+		lru_push_head(p->lru_list, b->lru);
+	p->lru_list->num_lru++;
+}
+
+// Scan doesn't move page.
+static void lru_access(buf_partition * p, Buf * b, ACCESS_TYPE type) {
+	if (type == ACCESS_SCAN)
+		return;
+	lru_unlink(b->lru);
+	lru_push_head(p->lru_list, b->lru);
+}
+
+static void lru_remove(buf_partition * p, Buf * b) {
+	lru_unlink(b->lru);
+	p->lru_list->num_lru--;
+}
+
+// Victim is the least recently used page which is not pinned.
+static Buf * lru_victim(buf_partition * p) {
+	LRU * cur;
+
+	for (cur = p->lru_list->tail->prev; cur != p->lru_list->head; cur = cur->prev) {
+		if (!is_pinned(cur->buf)) {
+			lru_remove(p, cur->buf);
+			return cur->buf;
+		}
+	}
+	return NULL;
+}
+
+static int lru_cold_pages(buf_partition * p, Buf ** out, int max) {
+	int n = 0;
+	LRU * cur;
+
+	for (cur = p->lru_list->tail->prev; cur != p->lru_list->head && n < max; cur = cur->prev)
+		if (!is_pinned(cur->buf))
+			out[n++] = cur->buf;
+	return n;
+}
+
+static void lru_resize(buf_partition * p) {
+}
+
+// Page goes back to cold end. Pages put back in reverse order keep their order.
+static void lru_reinsert(buf_partition * p, Buf * b) {
+	lru_push_tail(p->lru_list, b->lru);
+	p->lru_list->num_lru++;
+}
+
+static int lru_hot_pages(buf_partition * p, Buf ** out, int max) {
+	int n = 0;
+	LRU * cur;
+
+	for (cur = p->lru_list->head->next; cur != p->lru_list->tail && n < max; cur = cur->next)
+		out[n++] = cur->buf;
+	return n;
+}
+
+// CLOCK
+
+static void clock_init(buf_partition * p) {
+	p->hand = 0;
+}
+
+static void clock_resize(buf_partition * p) {
+	p->hand %= p->num_frames;
+}
+
+// Referenced pages are hotter than others.
+static int clock_hot_pages(buf_partition * p, Buf ** out, int max) {
+	int i, n = 0;
+	Buf * b;
+
+	for (i = 0; i < p->num_frames && n < max; i++) {
+		b = frame_at(p, i);
+		if (b->in_LRU && b->ref)
+			out[n++] = b;
+	}
+	for (i = 0; i < p->num_frames && n < max; i++) {
+		b = frame_at(p, i);
+		if (b->in_LRU && !b->ref)
+			out[n++] = b;
+	}
+	return n;
+}
+
+static void clock_destroy(buf_partition * p) {
+}
+
+// On hit, only reference bit is set.
+// Page read by scan doesn't get reference bit.
+static void clock_access(buf_partition * p, Buf * b, ACCESS_TYPE type) {
+	if (type == ACCESS_SCAN)
+		return;
+	b->ref = true;
+}
+
+static void clock_admit(buf_partition * p, Buf * b, ACCESS_TYPE type) {
+	b->ref = (type != ACCESS_SCAN);
+}
+
+static void clock_remove(buf_partition * p, Buf * b) {
+	b->ref = false;
+}
+
+// Victim stays in its frame without reference bit.
+static void clock_reinsert(buf_partition * p, Buf * b) {
+}
+
+/* Sweep frames from clock hand.
+ * Page whose reference bit is set gets second chance.
+ */
+static Buf * clock_victim(buf_partition * p) {
+	int i;
+	Buf * b;
+
+	// Two rounds are enough to clear every reference bit.
+	for (i = 0; i < p->num_frames * 2 + 1; i++) {
+		b = frame_at(p, p->hand);
+		p->hand = (p->hand + 1) % p->num_frames;
+
+		if (!b->in_LRU || is_pinned(b))
+			continue;
+		if (b->ref) {
+			b->ref = false;
+			continue;
+		}
+		return b;
+	}
+	return NULL;
+}
+
+// Pages ahead of clock hand without reference bit are evicted next.
+static int clock_cold_pages(buf_partition * p, Buf ** out, int max) {
+	int i, n = 0;
+	Buf * b;
+
+	for (i = 0; i < p->num_frames && n < max; i++) {
+		b = frame_at(p, (p->hand + i) % p->num_frames);
+		if (b->in_LRU && !is_pinned(b) && !b->ref)
+			out[n++] = b;
+	}
+	return n;
+}
+
+// CLOCK-Pro
+
+/* Frames are swept in frame order by two hands.
+ * Cold hand evicts cold pages and promotes cold pages
+ * which are re-accessed in their test period.
+ * Hot hand demotes hot pages which are not accessed.
+ * Evicted cold pages in test period are remembered in ghost ring
+ * as non-resident pages. If such page is loaded again,
+ * it becomes hot and the cold target grows.
+ * p->hand is cold hand.
+ */
+
+static void clock_pro_init(buf_partition * p) {
+	p->hot_hand = 0;
+	p->hand = 0;
+	p->num_hot = 0;
+	p->cold_target = 1;
+	init_page_hash(&p->ghost_table, p->num_frames);
+	p->ghost_ring = (hash_entry *)malloc(sizeof(hash_entry) * p->num_frames);
+	p->ghost_head = 0;
+	p->num_ghost = 0;
+}
+
+static void clock_pro_destroy(buf_partition * p) {
+	free_page_hash(&p->ghost_table);
+	free(p->ghost_ring);
+}
+
+// Ghost ring is sized to partition, so ghosts are forgotten.
+static void clock_pro_resize(buf_partition * p) {
+	free_page_hash(&p->ghost_table);
+	free(p->ghost_ring);
+	init_page_hash(&p->ghost_table, p->num_frames);
+	p->ghost_ring = (hash_entry *)malloc(sizeof(hash_entry) * p->num_frames);
+	p->ghost_head = 0;
+	p->num_ghost = 0;
+	p->hand %= p->num_frames;
+	p->hot_hand %= p->num_frames;
+	if (p->cold_target > p->num_frames - 1)
+		p->cold_target = p->num_frames > 1 ? p->num_frames - 1 : 1;
+}
+
+// Remember evicted page in its test period.
+static void ghost_push(buf_partition * p, Buf * b) {
+	int i;
+	hash_entry * e;
+
+	// If ring is full, test period of the oldest ghost ends.
+	if (p->num_ghost == p->num_frames) {
+		e = &p->ghost_ring[p->ghost_head];
+		if (e->page_offset != PAGE_NONE &&
+				hash_lookup(&p->ghost_table, e->table_id, e->page_offset) == p->ghost_head) {
+			hash_remove(&p->ghost_table, e->table_id, e->page_offset);
+			if (p->cold_target > 1)
+				p->cold_target--;
+		}
+		p->ghost_head = (p->ghost_head + 1) % p->num_frames;
+		p->num_ghost--;
+	}
+
+	i = (p->ghost_head + p->num_ghost) % p->num_frames;
+	p->ghost_ring[i].table_id = b->table_id;
+	p->ghost_ring[i].page_offset = b->page_offset;
+	hash_insert(&p->ghost_table, b->table_id, b->page_offset, i);
+	p->num_ghost++;
+}
+
+/* Run hot hand until one hot page is demoted.
+ * Test period of cold pages passed by hot hand ends.
+ */
+static void run_hot_hand(buf_partition * p) {
+	int i;
+	Buf * b;
+
+	for (i = 0; i < p->num_frames * 2 + 1; i++) {
+		b = frame_at(p, p->hot_hand);
+		p->hot_hand = (p->hot_hand + 1) % p->num_frames;
+
+		if (!b->in_LRU)
+			continue;
+		if (!b->hot) {
+			b->test = false;
+			continue;
+		}
+		if (b->ref) {
+			b->ref = false;
+			continue;
+		}
+		b->hot = false;
+		p->num_hot--;
+		return;
+	}
+}
+
+static void clock_pro_promote(buf_partition * p, Buf * b) {
+	b->hot = true;
+	b->test = false;
+	p->num_hot++;
+	if (p->num_hot > p->num_frames - p->cold_target)
+		run_hot_hand(p);
+}
+
+static void clock_pro_admit(buf_partition * p, Buf * b, ACCESS_TYPE type) {
+	int i;
+
+	b->ref = false;
+	b->hot = false;
+	b->test = true;
+
+	// Page read by scan is cold page without test period.
+	// It is neither promoted nor remembered as ghost.
+	if (type == ACCESS_SCAN) {
+		b->test = false;
+		return;
+	}
+
+	// Page is re-accessed within its test period.
+	if ((i = hash_lookup(&p->ghost_table, b->table_id, b->page_offset)) != HASH_EMPTY) {
+		hash_remove(&p->ghost_table, b->table_id, b->page_offset);
+		// Ghost stays in ring. It is invalidated by its page_offset.
+		p->ghost_ring[i].page_offset = PAGE_NONE;
+		if (p->cold_target < p->num_frames - 1)
+			p->cold_target++;
+		clock_pro_promote(p, b);
+	}
+}
+
+static void clock_pro_remove(buf_partition * p, Buf * b) {
+	if (b->hot)
+		p->num_hot--;
+	b->ref = false;
+	b->hot = false;
+	b->test = false;
+}
+
+/* Page stays cold. If victim remembered it as ghost,
+ * ghost is forgotten and its test period goes on.
+ */
+static void clock_pro_reinsert(buf_partition * p, Buf * b) {
+	int i;
+
+	if ((i = hash_lookup(&p->ghost_table, b->table_id, b->page_offset)) != HASH_EMPTY) {
+		hash_remove(&p->ghost_table, b->table_id, b->page_offset);
+		p->ghost_ring[i].page_offset = PAGE_NONE;
+		b->test = true;
+	}
+}
+
+static Buf * clock_pro_victim(buf_partition * p) {
+	int i;
+	Buf * b;
+
+	for (i = 0; i < p->num_frames * 4 + 1; i++) {
+		// Every cold page is pinned, demote hot page.
+		if (i > 0 && i % p->num_frames == 0)
+			run_hot_hand(p);
+
+		b = frame_at(p, p->hand);
+		p->hand = (p->hand + 1) % p->num_frames;
+
+		if (!b->in_LRU || is_pinned(b) || b->hot)
+			continue;
+		if (b->ref) {
+			b->ref = false;
+			if (b->test)
+				clock_pro_promote(p, b);
+			else
+				b->test = true;
+			continue;
+		}
+		if (b->test && b->page_offset != PAGE_NONE)
+			ghost_push(p, b);
+		clock_pro_remove(p, b);
+		return b;
+	}
+	return NULL;
+}
+
+// Hot pages first, then cold pages with reference bit, then the others.
+static int clock_pro_hot_pages(buf_partition * p, Buf ** out, int max) {
+	int i, n = 0, rank;
+	Buf * b;
+
+	for (rank = 0; rank < 3; rank++) {
+		for (i = 0; i < p->num_frames && n < max; i++) {
+			b = frame_at(p, i);
+			if (!b->in_LRU)
+				continue;
+			if ((rank == 0 && b->hot) || (rank == 1 && !b->hot && b->ref) ||
+					(rank == 2 && !b->hot && !b->ref))
+				out[n++] = b;
+		}
+	}
+	return n;
+}
+
+// Cold pages ahead of cold hand without reference bit are evicted next.
+static int clock_pro_cold_pages(buf_partition * p, Buf ** out, int max) {
+	int i, n = 0;
+	Buf * b;
+
+	for (i = 0; i < p->num_frames && n < max; i++) {
+		b = frame_at(p, (p->hand + i) % p->num_frames);
+		if (b->in_LRU && !is_pinned(b) && !b->hot && !b->ref)
+			out[n++] = b;
+	}
+	return n;
+}
+
+static replacer lru_replacer = {
+	lru_init, lru_destroy, lru_admit, lru_access, lru_remove, lru_victim,
+	lru_cold_pages, lru_resize, lru_hot_pages, lru_reinsert
+};
+
+static replacer clock_replacer = {
+	clock_init, clock_destroy, clock_admit, clock_access, clock_remove, clock_victim,
+	clock_cold_pages, clock_resize, clock_hot_pages, clock_reinsert
+};
+
+static replacer clock_pro_replacer = {
+	clock_pro_init, clock_pro_destroy, clock_pro_admit, clock_access,
+	clock_pro_remove, clock_pro_victim, clock_pro_cold_pages, clock_pro_resize,
+	clock_pro_hot_pages, clock_pro_reinsert
+};
+
+// Return replacement policy of its type.
+replacer * get_replacer(POLICY_TYPE type) {
+	switch (type) {
+		case POLICY_CLOCK :
+			return &clock_replacer;
+		case POLICY_CLOCK_PRO :
+			return &clock_pro_replacer;
+		default :
+			return &lru_replacer;
+	}
+}
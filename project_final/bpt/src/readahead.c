@@ -0,0 +1,224 @@
+/**
+ *		@class Database System
+ *		@file  readahead.c
+ *		@brief Read-ahead of leaf chain
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+/* Leaf pages are read one by one when leaf chain is followed.
+ * If leaf chain access is seen, read-ahead thread reads next leaves
+ * before they are used. Access is sequential if page is read
+ * by get_buf_scan, or if leaf is right sibling of the last leaf
+ * read in the same table.
+ * Leaves which are next to each other in file are read at once.
+ */
+
+// Number of leaves read ahead. Few frames are not filled by read-ahead.
+int readahead_window(void) {
+	int window = config.readahead_pages;
+
+	if (window > READAHEAD_MAX)
+		window = READAHEAD_MAX;
+	if (window > num_buf / 4)
+		window = num_buf / 4;
+	return window > 0 ? window : 0;
+}
+
+/* Called with every page returned by get_buf_access.
+ * If leaf chain is followed, ask thread to read next leaves.
+ * Request is made again after half of window is used.
+ */
+void readahead_hint(int table_id, Buf * b, ACCESS_TYPE type) {
+	int window;
+	int64_t offset, next, last;
+	leaf_page * leaf;
+	readahead_state * s;
+
+	offset = b->page_offset;
+	if (!__atomic_load_n(&ra_running, __ATOMIC_ACQUIRE) || offset <= HEADERPAGE_OFFSET)
+		return;
+	leaf = (leaf_page *)b->page;
+	if (!leaf->is_leaf)
+		return;
+
+	s = &ra_state[table_id];
+	next = leaf->right_sibling;
+	last = __atomic_exchange_n(&s->next_leaf, next, __ATOMIC_RELAXED);
+	if ((type != ACCESS_SCAN && last != offset) || next == 0)
+		return;
+
+	window = readahead_window();
+	pthread_mutex_lock(&ra_latch);
+	if (--s->countdown > 0)
+		window = 0;
+	else
+		s->countdown = window / 2;
+	pthread_mutex_unlock(&ra_latch);
+	request_readahead(table_id, next, window, next == offset + page_size);
+}
+
+/* Push request to queue of read-ahead thread.
+ * If queue is full, request is dropped.
+ */
+void request_readahead(int table_id, int64_t offset, int num, bool contiguous) {
+	readahead_req * r;
+
+	pthread_mutex_lock(&ra_latch);
+	if (ra_num < READAHEAD_QUEUE && num > 0) {
+		r = &ra_queue[(ra_head + ra_num) % READAHEAD_QUEUE];
+		r->table_id = table_id;
+		r->offset = offset;
+		r->num = num;
+		r->contiguous = contiguous;
+		ra_num++;
+		pthread_cond_signal(&ra_cond);
+	}
+	pthread_mutex_unlock(&ra_latch);
+}
+
+// Forget leaf chain access of closed table.
+void reset_readahead(int table_id) {
+	pthread_mutex_lock(&ra_latch);
+	ra_state[table_id].countdown = 0;
+	__atomic_store_n(&ra_state[table_id].next_leaf, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&ra_latch);
+}
+
+/* If leaf page is in buffer, get its right sibling.
+ * Return 1 if page is in buffer, otherwise 0.
+ * Next is 0 if page is not leaf.
+ */
+static int resident_sibling(int table_id, int64_t offset, int64_t * next) {
+	int i;
+	leaf_page * leaf;
+	buf_partition * p;
+
+	p = get_partition(table_id, offset);
+	pthread_mutex_lock(&p->latch);
+	if ((i = hash_lookup(&p->page_table, table_id, offset)) == HASH_EMPTY) {
+		pthread_mutex_unlock(&p->latch);
+		return 0;
+	}
+	leaf = (leaf_page *)buf[i].page;
+	*next = leaf->is_leaf ? leaf->right_sibling : 0;
+	pthread_mutex_unlock(&p->latch);
+	return 1;
+}
+
+/* Read num leaves following leaf chain from offset.
+ * If leaves were next to each other in file, pages after
+ * current leaf are reserved and read by one preadv.
+ * Table latch is held, so tree is not changed meanwhile.
+ */
+static void readahead_leaves(readahead_req * r) {
+	int i, n, max, left;
+	int64_t cur, next, prev, free_offset;
+	bool contiguous;
+	Buf * run[READAHEAD_MAX];
+	struct iovec iov[READAHEAD_MAX];
+	leaf_page * leaf;
+
+	pthread_rwlock_rdlock(&table_latch[r->table_id]);
+	if (table[r->table_id] == 0) {
+		pthread_rwlock_unlock(&table_latch[r->table_id]);
+		return;
+	}
+	free_offset = descs[r->table_id].free_page;
+
+	cur = r->offset;
+	left = r->num < READAHEAD_MAX ? r->num : READAHEAD_MAX;
+	contiguous = r->contiguous;
+	// Page from free page is not allocated yet.
+	while (left > 0 && cur > HEADERPAGE_OFFSET && cur < free_offset &&
+			__atomic_load_n(&ra_running, __ATOMIC_ACQUIRE)) {
+		if (resident_sibling(r->table_id, cur, &next)) {
+			left--;
+			cur = next;
+			continue;
+		}
+
+		// Reserve frames of run. Run ends at page in buffer.
+		max = contiguous ? left : 1;
+		for (n = 0; n < max && cur + n * page_size < free_offset; n++) {
+			if (reserve_frame(r->table_id, cur + n * page_size, true, &run[n]) != 0 ||
+					run[n] == NULL)
+				break;
+			iov[n].iov_base = run[n]->page;
+			iov[n].iov_len = page_size;
+		}
+		// Every frame is pinned.
+		if (n == 0)
+			break;
+		// Failed or short read leaves stale bytes, so frames are dropped.
+		if (read_pages(r->table_id, iov, n, cur) != 0) {
+			for (i = 0; i < n; i++)
+				cancel_frame(run[i]);
+			break;
+		}
+
+		// Follow leaf chain through pages just read.
+		next = cur;
+		prev = cur;
+		while (left > 0 && next >= cur && next < cur + n * page_size) {
+			leaf = (leaf_page *)run[(next - cur) / page_size]->page;
+			if (!leaf->is_leaf) {
+				next = 0;
+				break;
+			}
+			left--;
+			prev = next;
+			next = leaf->right_sibling;
+		}
+		contiguous = next == prev + page_size;
+
+		for (i = 0; i < n; i++)
+			complete_frame(run[i], ACCESS_SCAN);
+		cur = next;
+	}
+	pthread_rwlock_unlock(&table_latch[r->table_id]);
+}
+
+// Read-ahead thread. It reads leaves requested by readahead_hint.
+void * readahead(void * arg) {
+	readahead_req r;
+
+	pthread_mutex_lock(&ra_latch);
+	while (ra_running) {
+		if (ra_num == 0) {
+			pthread_cond_wait(&ra_cond, &ra_latch);
+			continue;
+		}
+		r = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % READAHEAD_QUEUE;
+		ra_num--;
+		pthread_mutex_unlock(&ra_latch);
+		readahead_leaves(&r);
+		pthread_mutex_lock(&ra_latch);
+	}
+	pthread_mutex_unlock(&ra_latch);
+	return NULL;
+}
+
+void start_readahead(void) {
+	if (readahead_window() == 0)
+		return;
+	ra_running = true;
+	if (pthread_create(&ra_thread, NULL, readahead, NULL) != 0) {
+		printf("fail to start read-ahead\n");
+		ra_running = false;
+	}
+}
+
+void stop_readahead(void) {
+	if (!ra_running)
+		return;
+	pthread_mutex_lock(&ra_latch);
+	__atomic_store_n(&ra_running, false, __ATOMIC_RELEASE);
+	ra_num = 0;
+	pthread_cond_broadcast(&ra_cond);
+	pthread_mutex_unlock(&ra_latch);
+	pthread_join(ra_thread, NULL);
+}
@@ -0,0 +1,112 @@
+/**
+ *		@class Database System
+ *		@file  search.c
+ *		@brief Key search in page
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+#include <immintrin.h>
+
+/* Keys of page are found by branchless binary search
+ * until SEARCH_BLOCK keys are left. Keys of the block are
+ * compared with key at once and counted by SIMD kernel.
+ * Kernel is chosen by CPU features when database starts.
+ * Keys of leaf are contiguous. Keys of internal page are
+ * stride int64 apart, because page offset follows each key.
+ */
+
+typedef int (*count_kernel)(const int64_t * keys, int stride, int num, int64_t key, bool less);
+
+// Count keys <= key, or keys < key if less is true.
+static int count_scalar(const int64_t * keys, int stride, int num, int64_t key, bool less) {
+	int i, n = 0;
+
+	for (i = 0; i < num; i++)
+		n += less ? keys[i * stride] < key : keys[i * stride] <= key;
+	return n;
+}
+
+// SSE4.2 has 64-bit compare. Two keys are compared at once.
+__attribute__((target("sse4.2")))
+static int count_sse42(const int64_t * keys, int stride, int num, int64_t key, bool less) {
+	int i, n = 0;
+	__m128i k = _mm_set1_epi64x(key);
+	__m128i v, gt;
+
+	for (i = 0; i + 2 <= num; i += 2) {
+		v = stride == 1 ? _mm_loadu_si128((const __m128i *)(keys + i)) :
+			_mm_set_epi64x(keys[(i + 1) * stride], keys[i * stride]);
+		// Keys < key are key > keys. Keys <= key are not keys > key.
+		gt = less ? _mm_cmpgt_epi64(k, v) : _mm_cmpgt_epi64(v, k);
+		n += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(gt)));
+	}
+	if (!less)
+		n = i - n;
+	return n + count_scalar(keys + i * stride, stride, num - i, key, less);
+}
+
+// AVX2 loads or gathers four keys and compares them at once.
+__attribute__((target("avx2")))
+static int count_avx2(const int64_t * keys, int stride, int num, int64_t key, bool less) {
+	int i, n = 0;
+	__m256i k = _mm256_set1_epi64x(key);
+	__m256i index = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+	__m256i v, gt;
+
+	for (i = 0; i + 4 <= num; i += 4) {
+		v = stride == 1 ? _mm256_loadu_si256((const __m256i *)(keys + i)) :
+			_mm256_i64gather_epi64((const long long *)(keys + i * stride), index, 8);
+		gt = less ? _mm256_cmpgt_epi64(k, v) : _mm256_cmpgt_epi64(v, k);
+		n += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+	}
+	if (!less)
+		n = i - n;
+	return n + count_scalar(keys + i * stride, stride, num - i, key, less);
+}
+
+static count_kernel count_keys = count_scalar;
+
+// Choose kernel by CPU features.
+void init_search(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		count_keys = count_avx2;
+	else if (__builtin_cpu_supports("sse4.2"))
+		count_keys = count_sse42;
+	else
+		count_keys = count_scalar;
+}
+
+/* Count sorted keys <= key, or < key if less is true.
+ * Answer is kept in [base, base + num]. If key at base + half - 1
+ * fits, answer is not below base + half. If not, it is below it,
+ * so range of num - half keys from base still holds it.
+ */
+static int search_keys(const int64_t * keys, int stride, int num, int64_t key, bool less) {
+	int base = 0, half;
+	int64_t k;
+
+	while (num > SEARCH_BLOCK) {
+		half = num / 2;
+		k = keys[(base + half - 1) * stride];
+		base += (less ? k < key : k <= key) * half;
+		num -= half;
+	}
+	return base + count_keys(keys + base * stride, stride, num, key, less);
+}
+
+/* Number of keys <= key in internal page.
+ * Child to follow is one_more_page if it is 0,
+ * otherwise records[i - 1].page_offset.
+ */
+int search_internal(internal_page * page, int64_t key) {
+	return search_keys(&page->records[0].key, sizeof(internal_record) / sizeof(int64_t),
+			page->num_keys, key, false);
+}
+
+// Index of the first record whose key >= key in leaf page.
+int search_leaf(leaf_page * page, int64_t key) {
+	return search_keys(page->keys, 1, page->num_keys, key, true);
+}
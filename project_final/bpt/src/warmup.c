@@ -0,0 +1,238 @@
+/**
+ *		@class Database System
+ *		@file  warmup.c
+ *		@brief Warm-up of buffer pool after restart
+ *		@author Kibeom Kwon (kgbum2222@gmail.com)
+ *		@since 2017-12-17
+ */
+
+#include "bpt.h"
+
+/* Resident pages are saved to WARMUP_FILE in hotness order
+ * at shutdown_db and at checkpoint.
+ * After restart, pages of each opened table are read again
+ * by warm-up thread. It never evicts page, so it stops
+ * when buffer pool is full.
+ */
+
+static int compare_offset(const void * a, const void * b) {
+	int64_t x = ((const warm_page *)a)->page_offset;
+	int64_t y = ((const warm_page *)b)->page_offset;
+	return x < y ? -1 : x > y;
+}
+
+/* Save resident pages in hotness order.
+ * Pages of partitions are interleaved, hottest first.
+ * File is replaced by rename, so crash leaves old list.
+ * If success, return the number of saved pages. Otherwise, return -1.
+ */
+int save_warm_pages(void) {
+	int i, j, n, fd, max;
+	int * num_hot;
+	Buf ** hot;
+	warm_page * pages, * list;
+	buf_partition * p;
+	char tmp[64];
+
+	max = (max_buf + num_partitions - 1) / num_partitions;
+	hot = (Buf **)malloc(sizeof(Buf *) * max);
+	pages = (warm_page *)malloc(sizeof(warm_page) * max * num_partitions);
+	num_hot = (int *)malloc(sizeof(int) * num_partitions);
+	list = (warm_page *)malloc(sizeof(warm_page) * max * num_partitions);
+
+	// Pages are copied while latch is held.
+	for (i = 0; i < num_partitions; i++) {
+		p = &partitions[i];
+		pthread_mutex_lock(&p->latch);
+		n = policy->hot_pages(p, hot, max);
+		num_hot[i] = 0;
+		for (j = 0; j < n; j++) {
+			// Output page of join is not a page of table.
+			if (hot[j]->page_offset < 0)
+				continue;
+			pages[i * max + num_hot[i]].table_id = hot[j]->table_id;
+			pages[i * max + num_hot[i]].page_offset = hot[j]->page_offset;
+			num_hot[i]++;
+		}
+		pthread_mutex_unlock(&p->latch);
+	}
+	n = 0;
+	for (j = 0; j < max; j++)
+		for (i = 0; i < num_partitions; i++)
+			if (j < num_hot[i])
+				list[n++] = pages[i * max + j];
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", WARMUP_FILE);
+	if ((fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644)) == -1) {
+		printf("fail to save warm-up file\n");
+		n = -1;
+	} else {
+		write(fd, list, sizeof(warm_page) * n);
+		close(fd);
+		rename(tmp, WARMUP_FILE);
+	}
+
+	free(hot);
+	free(pages);
+	free(num_hot);
+	free(list);
+	return n;
+}
+
+// Read list of pages saved by save_warm_pages.
+void load_warm_list(void) {
+	int fd;
+	off_t size;
+
+	warm_list = NULL;
+	num_warm = 0;
+	if ((fd = open(WARMUP_FILE, O_RDONLY)) == -1)
+		return;
+
+	size = lseek(fd, 0, SEEK_END);
+	num_warm = size / sizeof(warm_page);
+	if (num_warm > 0) {
+		warm_list = (warm_page *)malloc(sizeof(warm_page) * num_warm);
+		num_warm = pread(fd, warm_list, sizeof(warm_page) * num_warm, 0) / sizeof(warm_page);
+	}
+	close(fd);
+}
+
+/* Read saved pages of table.
+ * Pages are taken in hotness order, and each batch
+ * is sorted by offset, so reads go forward in file.
+ * Whole batch is submitted to I/O backend at once, and
+ * pages next to each other in file are read by one request.
+ * Table latch is held while batch is read, so pages are not
+ * allocated or freed meanwhile.
+ */
+static void warm_table(int table_id) {
+	int i, j, k, n, num_req, num_frame, loaded, full;
+	warm_page batch[WARMUP_BATCH];
+	Buf * frames[WARMUP_BATCH];
+	struct iovec iov[WARMUP_BATCH];
+	io_request reqs[WARMUP_BATCH];
+	io_request * last;
+	Buf * b;
+	int64_t free_offset;
+
+	i = 0;
+	while (i < num_warm) {
+		n = 0;
+		for (; i < num_warm && n < WARMUP_BATCH; i++)
+			if (warm_list[i].table_id == table_id)
+				batch[n++] = warm_list[i];
+		if (n == 0)
+			break;
+		qsort(batch, n, sizeof(warm_page), compare_offset);
+
+		pthread_rwlock_rdlock(&table_latch[table_id]);
+		if (table[table_id] == 0 || !__atomic_load_n(&warm_running, __ATOMIC_ACQUIRE)) {
+			pthread_rwlock_unlock(&table_latch[table_id]);
+			return;
+		}
+		free_offset = descs[table_id].free_page;
+
+		loaded = full = num_req = num_frame = 0;
+		for (j = 0; j < n; j++) {
+			// Pages are allocated in offset order from free page.
+			// Page from free page is read only when it is allocated.
+			if (batch[j].page_offset >= free_offset)
+				continue;
+			// Warm-up never evicts page.
+			if (reserve_frame(table_id, batch[j].page_offset, false, &b) != 0) {
+				full++;
+				continue;
+			}
+			loaded++;
+			if (b == NULL)
+				continue;
+
+			frames[num_frame] = b;
+			iov[num_frame].iov_base = b->page;
+			iov[num_frame].iov_len = page_size;
+			last = num_req > 0 ? &reqs[num_req - 1] : NULL;
+			if (last != NULL && last->offset + last->num * page_size == b->page_offset) {
+				last->num++;
+			} else {
+				reqs[num_req].table_id = table_id;
+				reqs[num_req].offset = b->page_offset;
+				reqs[num_req].iov = &iov[num_frame];
+				reqs[num_req].num = 1;
+				reqs[num_req].write = false;
+				num_req++;
+			}
+			num_frame++;
+		}
+		io->submit(reqs, num_req);
+		// Frames of failed or short read are dropped, not published.
+		for (j = 0, k = 0; j < num_req; j++) {
+			for (n = 0; n < reqs[j].num; n++, k++) {
+				if (reqs[j].result == (ssize_t)reqs[j].num * page_size)
+					complete_frame(frames[k], ACCESS_SCAN);
+				else
+					cancel_frame(frames[k]);
+			}
+		}
+		pthread_rwlock_unlock(&table_latch[table_id]);
+
+		// Every page was refused, so buffer pool is full.
+		if (loaded == 0 && full > 0)
+			return;
+	}
+}
+
+// Warm-up thread. It warms tables requested by open_table.
+void * warmup(void * arg) {
+	int t;
+
+	pthread_mutex_lock(&warm_latch);
+	while (warm_running) {
+		for (t = 0; t < 11; t++)
+			if (warm_pending[t])
+				break;
+		if (t == 11) {
+			pthread_cond_wait(&warm_cond, &warm_latch);
+			continue;
+		}
+		warm_pending[t] = false;
+		pthread_mutex_unlock(&warm_latch);
+		warm_table(t);
+		pthread_mutex_lock(&warm_latch);
+	}
+	pthread_mutex_unlock(&warm_latch);
+	return NULL;
+}
+
+// Ask warm-up thread to read saved pages of table.
+void request_warmup(int table_id) {
+	if (num_warm == 0)
+		return;
+	pthread_mutex_lock(&warm_latch);
+	warm_pending[table_id] = true;
+	pthread_cond_signal(&warm_cond);
+	pthread_mutex_unlock(&warm_latch);
+}
+
+void start_warmup(void) {
+	if (num_warm == 0)
+		return;
+	warm_running = true;
+	if (pthread_create(&warm_thread, NULL, warmup, NULL) != 0) {
+		printf("fail to start warm-up\n");
+		warm_running = false;
+	}
+}
+
+void stop_warmup(void) {
+	if (warm_running) {
+		pthread_mutex_lock(&warm_latch);
+		__atomic_store_n(&warm_running, false, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&warm_cond);
+		pthread_mutex_unlock(&warm_latch);
+		pthread_join(warm_thread, NULL);
+	}
+	free(warm_list);
+	warm_list = NULL;
+	num_warm = 0;
+}